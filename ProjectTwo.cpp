@@ -14,138 +14,911 @@
  * the tree is relatively balanced this will be quick. Because the tree is sorted,
  * lookups are also O(h), and printing the sorted list of courses is O(n).
  *
- * There is a secondary list, which is only used for validation of the prerequisite
+ * Unfortunately the registrar exports the catalog already sorted by course
+ * number, which is the worst possible input for a plain BST - every insert goes
+ * to the right of the last one and the tree degenerates into a linked list. To
+ * guard against this the default index engine is an AVL tree, which rebalances
+ * itself on insert so that h stays at O(log n) whatever order the data arrives
+ * in. The original unbalanced tree is still available (pass `--index=bst`) so
+ * that the two can be compared.
+ *
+ * Once a catalog has loaded it is only ever searched, so `--index=eytzinger`
+ * swaps the tree for a read-only index with every course number in a single
+ * array, laid out as an implicit tree in breadth first (Eytzinger) order. That
+ * touches a handful of cache lines per search instead of one per level, and
+ * the next few levels can be prefetched while the current one is compared.
+ *
+ * For a full load there is an even cheaper option than inserting the courses one
+ * at a time. The loader collects every parsed course first, sorts them (a no-op
+ * beyond a single O(n) check when the export is already sorted), and then builds
+ * a perfectly balanced tree bottom-up by making the middle course of each range
+ * the root of that range. Every node is visited exactly once, so building the
+ * index is O(n) rather than O(n log n). This is the default (`--load=bulk`), the
+ * one-at-a-time path is kept as `--load=insert`.
+ *
+ * The csv file is memory-mapped rather than read through a stream, and each line
+ * is split into fields in place using `string_view`s which point straight into
+ * the mapping. The only copies made are into the final `Course` structure,
+ * rather than the three heap allocations per field which the original
+ * `ifstream`/`getline`/`stringstream` combination needed.
+ * Finding the delimiters takes a single pass, which compares 16 bytes at a
+ * time against both the comma and the line feed using SSE2 (or NEON), and
+ * each field is then cut out from between the commas it found.
+ *
+ * Everything that is built during a load - the tree nodes, each course's copy of
+ * its title, and the prerequisite lists - is carved out of a per-load
+ * `Arena`, which hands out memory from large blocks by bumping a pointer. Nodes
+ * end up next to each other in memory, there is no per-allocation overhead, and
+ * emptying the tree frees a handful of blocks in one go instead of recursively
+ * deleting one node at a time (which could also overflow the stack on a
+ * degenerate tree).
+ *
+ * Large files are parsed in parallel. The mapping is split into one chunk per
+ * thread at line boundaries, and each thread parses its chunk into its own
+ * arena, course list and prerequisites table so that nothing is shared while
+ * parsing. Afterwards the arenas are spliced into the index's arena, the
+ * prerequisite tables are merged, and the course lists are concatenated in
+ * file order and bulk built into the index.
+ *
+ * A catalog can be spread over several csv files, one per department or campus,
+ * which are mapped side by side and their chunks parsed together as if they were
+ * one file, so a prerequisite may name a course in any of them. With `--shard`
+ * the index itself is split as well, into one `ShardedIndex` shard per
+ * department which are built in parallel, and each lookup is routed to the
+ * shard of its course's department.
+ *
+ * Parsing and validating the csv file can be skipped altogether on later runs by
+ * passing `--snapshot=PATH`. After a successful load the validated catalog is
+ * written there in a compact binary format, already sorted into index order.
+ * On the next start, if the snapshot is newer than the csv file (its recorded
+ * size and modification time still match), it is mapped into memory and the
+ * index is built straight from it - titles and prerequisite lists are used in
+ * place from the mapping, and nothing is parsed or validated again.
+ *
+ * The index and the prerequisites table which validated it together make up a
+ * `Catalog`. The driver publishes the current catalog through an atomically
+ * swapped `shared_ptr`, and every query takes its own reference to it. A catalog
+ * whose index can be changed is reloaded in place by `Catalog::refresh`, in the
+ * foreground and in the background alike: it parses, diffs and validates the
+ * new files while the catalog is still being read, and only takes the catalog
+ * to itself to apply the changes. Every read goes through a handle from
+ * `Catalog::pin`, a shared lock on the catalog which the menu holds for each
+ * query, so a refresh waits for the queries in flight and they never see it
+ * half done. Only the read-only Eytzinger index is still built as a whole new
+ * catalog on the side and swapped in, so queries which are already running
+ * finish against the old one without any locks. Batch lookups split each block
+ * of queries across several reader threads which do not pin, so nothing may
+ * refresh once querying has started: batch mode reloads before it starts, and
+ * then freezes the catalog with `Catalog::freeze`, after which a refresh throws.
+ *
+ * There is a secondary list, which is used for validation of the prerequisite
  * courses during the loading process. We need to maintain a (temporary) list of
  * prerequisites as each course is loaded, and then once loading is complete check
  * to ensure that those prerequisite courses actually exist. This could have been
  * a simple vector, however, by implementing a minimal hash table we gain the
  * benefit of not having to check the same course multiple times, as the hash table
- * will not have duplicates.
+ * will not have duplicates. Each entry also remembers the course it resolved to,
+ * so that afterwards every course's prerequisites can be linked directly to the
+ * courses they name with one hash lookup apiece instead of a search of the tree.
  *
- * This is not a production-ready HashMap, just a quickly knocked together structure
- * which should meet the requirements in as efficient a manner as possible. The
- * default size for the internal array was chosen by trial and error so that the
- * simple modulo based hash produced no collisions with the data we were given and
- * to keep the space requirement small. A larger data set would by necessity
- * require a larger capacity, and possibly the ability to dynamically grow as
- * needed.
+ * The hash table started out as a quickly knocked together structure sized by
+ * trial and error for the data we were given, using a simple modulo of the raw
+ * course id bytes as the hash. That clusters badly for ids which share a
+ * department prefix, and once the table filled up new prerequisites were
+ * silently dropped. It now runs the course id through a proper 64-bit mixing
+ * function, keeps its capacity at a power of 2 so that the probe sequence is a
+ * cheap mask rather than a modulo, and doubles in size whenever the number of
+ * entries would exceed the configured load factor.
  *
  * Compiling
  *
- * This program was designed with the assumption that the data being input is the
- * data we were given as testing. It uses a default capacity for the prerequisites
- * hash table of 27. If a larger dataset is to be loaded, this should be changed
- * to a higher number. For the best chance of avoiding hash collisions, choose
- * a number which is not a power of 2, preferably odd. Depending on the compiler,
- * this might be able to be passed into the compiler in the CPPFLAGS environment
- * variable. Otherwise, edit the `DEFAULT_PREREQUISITE_TABLE_SIZE` macro in this
- * file.
+ * The prerequisites hash table starts with a capacity of 27 (rounded up to the
+ * next power of 2) and grows once it is more than 70% full. Both can be changed
+ * at runtime with the `--table-size=N` and `--load-factor=F` options, or the
+ * defaults can be changed at compile time by passing `-D` flags in the CPPFLAGS
+ * environment variable for the `DEFAULT_PREREQUISITE_TABLE_SIZE` and
+ * `DEFAULT_PREREQUISITE_LOAD_FACTOR` macros.
+ *
+ * Course numbers are 7 characters long. A catalog with longer (or shorter)
+ * numbers needs a build with `COURSE_KEY_WIDTH` defined to their width, such
+ * as `CPPFLAGS=-DCOURSE_KEY_WIDTH=10 make`. The keys are packed for that
+ * width at compile time, and a snapshot only loads into a build of the same
+ * width.
  */
 
+#ifndef COURSE_KEY_WIDTH
+#define COURSE_KEY_WIDTH 7
+#endif // !COURSE_KEY_WIDTH
+
 #ifndef DEFAULT_PREREQUISITE_TABLE_SIZE
 #define DEFAULT_PREREQUISITE_TABLE_SIZE 27
 #endif // !DEFAULT_PREREQUISITE_TABLE_SIZE
 
+#ifndef MAX_PREREQUISITE_TABLE_SIZE
+#define MAX_PREREQUISITE_TABLE_SIZE ((u_int64_t)1 << 32)
+#endif // !MAX_PREREQUISITE_TABLE_SIZE
+
+#ifndef DEFAULT_PREREQUISITE_LOAD_FACTOR
+#define DEFAULT_PREREQUISITE_LOAD_FACTOR 0.7
+#endif // !DEFAULT_PREREQUISITE_LOAD_FACTOR
+
+#ifndef PARALLEL_CHUNK_SIZE
+#define PARALLEL_CHUNK_SIZE (1024 * 1024)
+#endif // !PARALLEL_CHUNK_SIZE
+
+#ifndef STREAM_CHUNK_SIZE
+#define STREAM_CHUNK_SIZE (1024 * 1024)
+#endif // !STREAM_CHUNK_SIZE
+
+#ifndef DETAILS_CACHE_SETS
+#define DETAILS_CACHE_SETS 64
+#endif // !DETAILS_CACHE_SETS
+
+#ifndef DETAILS_CACHE_WAYS
+#define DETAILS_CACHE_WAYS 8
+#endif // !DETAILS_CACHE_WAYS
+
+#ifndef PROGRESS_LINES
+#define PROGRESS_LINES 4096
+#endif // !PROGRESS_LINES
+
+#ifndef DEFAULT_TERM_CAP
+#define DEFAULT_TERM_CAP 4
+#endif // !DEFAULT_TERM_CAP
+
+#ifndef DEFAULT_BENCH_MAX_EXPONENT
+#define DEFAULT_BENCH_MAX_EXPONENT 7
+#endif // !DEFAULT_BENCH_MAX_EXPONENT
+
+#ifndef BENCH_DEGENERATE_LIMIT
+#define BENCH_DEGENERATE_LIMIT 20000
+#endif // !BENCH_DEGENERATE_LIMIT
+
+#ifndef DEFAULT_INDEX_ENGINE
+#define DEFAULT_INDEX_ENGINE IndexAVL
+#endif // !DEFAULT_INDEX_ENGINE
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif // __GNUC__ || __clang__
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <fstream>
+#include <functional>
 #include <iostream>
-#include <sstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <shared_mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#if defined(__SSE2__)
+   #include <emmintrin.h>
+   #define CSV_SCAN_SIMD
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+   #include <arm_neon.h>
+   #define CSV_SCAN_SIMD
+#endif // __SSE2__
+
 #ifdef _WIN32
    #include <io.h> 
    #define access    _access_s
+   #define isatty    _isatty
 #else
+   #include <fcntl.h>
+   #include <sys/mman.h>
    #include <unistd.h>
 #endif // _WIN32
 
 using namespace std;
 
 /**
- * Represents a course prerequisite by course number
+ * A read-only view of an entire file. On POSIX systems the file is mapped into
+ * memory, so the data is paged in by the kernel as it is touched and never
+ * copied into the program's own buffers. Elsewhere we fall back to reading the
+ * whole file into memory in one go, which is still far cheaper than reading it
+ * a line at a time.
  */
-struct Prerequisite {
+class MappedFile {
+    private:
+        const char *data;   //! The start of the file contents
+        size_t      length; //! The size of the file in bytes
+        string      buffer; //! Backing storage for the non-mmap fallback
+
+    public:
+        MappedFile();                 //! Constructor
+        virtual ~MappedFile();        //! Destructor
+        bool open(const string &path); //! Maps the file at `path`
+        void close();                 //! Unmaps the file
+        string_view view();           //! Getter for the file contents
+};
+
+/**
+ * Constructor
+ */
+MappedFile::MappedFile() {
+    data = nullptr;
+    length = 0;
+}
+
+/**
+ * Destructor
+ */
+MappedFile::~MappedFile() {
+    close();
+}
+
+/**
+ * Maps a file into memory
+ * \param path the path to the file
+ * \return true if the file was mapped, false if it could not be opened
+ */
+bool MappedFile::open(const string &path) {
+    close();
+#ifdef _WIN32
+    ifstream infs(path, ios::binary);
+    if (!infs)
+        return false;
+    buffer.assign(istreambuf_iterator<char>(infs), istreambuf_iterator<char>());
+    data = buffer.data();
+    length = buffer.size();
+    return true;
+#else
+    struct stat st;
+    int         fd;
+    void       *addr;
+
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    // mmap refuses a zero length mapping, but an empty file is still valid
+    if (st.st_size > 0) {
+        addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        // We only ever walk the file front to back
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        data = (const char *)addr;
+        length = st.st_size;
+    }
+    // The mapping stays valid once the descriptor is closed
+    ::close(fd);
+    return true;
+#endif // _WIN32
+}
+
+/**
+ * Releases the mapping, if there is one
+ */
+void MappedFile::close() {
+#ifndef _WIN32
+    if (data != nullptr)
+        munmap((void *)data, length);
+#endif // !_WIN32
+    buffer.clear();
+    data = nullptr;
+    length = 0;
+}
+
+/**
+ * Getter
+ * \return a view of the entire file contents, valid until `close` is called
+ */
+string_view MappedFile::view() {
+    return string_view(data, length);
+}
+
+/**
+ * A bump allocator. Memory is handed out from large blocks, and is only ever
+ * given back all at once when the arena is reset or destroyed. Destructors are
+ * never run for objects created in the arena, so only trivially destructible
+ * types may be stored in it.
+ *
+ * The blocks normally come from the heap, but once `mapTo` has been called they
+ * are mapped from a scratch file instead, so the operating system can write
+ * them out to the file and drop them from memory rather than swapping.
+ */
+class Arena {
+    private:
+        /**
+         * The header of each block of memory. The usable space follows
+         * immediately after it.
+         */
+        struct alignas(alignof(max_align_t)) Block {
+            Block  *next;   //! The previously allocated block
+            size_t  size;   //! The usable size of this block
+            size_t  used;   //! The number of bytes already handed out
+            size_t  mapped; //! The length of the block's mapping, 0 if it came from the heap
+        };
+
+        Block     *head;        //! The block currently being allocated from
+        size_t     blockSize;   //! The default size of each new block
+        size_t     total;       //! The total number of bytes handed out
+        string     backingPath; //! Where the scratch file is created, empty for the heap
+        int        backing;     //! The scratch file the blocks are mapped from, or -1
+        u_int64_t  backingSize; //! The size of `backing`
+
+        vector<shared_ptr<void>> retained; //! Outside resources which live as long as the arena
+
+        Block *addBlock(size_t size); //! Allocates a new block of at least `size` bytes
+        void   release();     //! Frees every block and retained resource
+        void   openBacking(); //! Creates a fresh scratch file at `backingPath`
+
+    public:
+        Arena();                         //! Constructor
+        Arena(size_t blockSize);         //! Constructor, with block size specifier
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+        virtual ~Arena();                //! Destructor
+        void  *allocate(size_t bytes, size_t align); //! Allocates raw memory
+        string_view copy(string_view str); //! Copies a string into the arena
+        void   retain(shared_ptr<void> resource); //! Keeps `resource` alive until reset
+        void   adopt(Arena &other);      //! Takes over everything allocated by `other`
+        void   reset();                  //! Releases everything at once
+        void   mapTo(const string &path); //! Maps the blocks from a scratch file from now on
+        size_t getSize();                //! Getter for the `total` property
+
+        /**
+         * Constructs a new object in the arena
+         * \param args the arguments to pass to the constructor
+         * \return the new object, which lives until the arena is reset
+         */
+        template <typename T, typename... Args>
+        T *create(Args &&...args) {
+            static_assert(is_trivially_destructible<T>::value,
+                    "Arena objects are never destroyed");
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        /**
+         * Allocates an uninitialized array in the arena
+         * \param count the number of elements
+         * \return the first element of the array
+         */
+        template <typename T>
+        T *allocateArray(size_t count) {
+            static_assert(is_trivially_destructible<T>::value,
+                    "Arena objects are never destroyed");
+            return (T *)allocate(sizeof(T) * count, alignof(T));
+        }
+};
+
+/**
+ * A fixed size array which lives in an `Arena`. This is just a pointer and a
+ * length, so it can be copied around freely, but it does not own its data.
+ */
+template <typename T>
+struct ArenaArray {
+    T         *data = nullptr; //! The first element
+    u_int32_t  size = 0;       //! The number of elements
+
+    T *begin() const { return data; }
+    T *end() const { return data + size; }
+    bool empty() const { return size == 0; }
+    T &operator[](size_t i) const { return data[i]; }
+};
+
+/**
+ * Default constructor, using 64KiB blocks
+ */
+Arena::Arena() : Arena(64 * 1024) {
+}
+
+/**
+ * Constructor
+ * \param blockSize the size of each block of memory
+ */
+Arena::Arena(size_t blockSize) {
+    this->head = nullptr;
+    this->blockSize = blockSize;
+    this->total = 0;
+    this->backing = -1;
+    this->backingSize = 0;
+}
+
+/**
+ * Destructor
+ */
+Arena::~Arena() {
+    release();
+#ifndef _WIN32
+    if (this->backing >= 0)
+        ::close(this->backing);
+#endif // !_WIN32
+}
+
+/**
+ * Allocates a new block and makes it the current block
+ * \param size the minimum usable size of the block
+ * \return the new block
+ */
+Arena::Block *Arena::addBlock(size_t size) {
+    Block *block;
+
+    // Large requests get a block to themselves
+    if (size < this->blockSize)
+        size = this->blockSize;
+#ifndef _WIN32
+    if (this->backing >= 0) {
+        // Each block is mapped from the end of the file, so it has to be a
+        // whole number of pages
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t length = (sizeof(Block) + size + page - 1) & ~(page - 1);
+        void  *addr;
+
+        if (ftruncate(this->backing, this->backingSize + length) != 0)
+            throw bad_alloc();
+        addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                this->backing, this->backingSize);
+        if (addr == MAP_FAILED)
+            throw bad_alloc();
+        this->backingSize += length;
+        block = (Block *)addr;
+        block->next = this->head;
+        block->size = length - sizeof(Block);
+        block->used = 0;
+        block->mapped = length;
+        this->head = block;
+        return block;
+    }
+#endif // !_WIN32
+    block = (Block *)malloc(sizeof(Block) + size);
+    if (block == nullptr)
+        throw bad_alloc();
+    block->next = this->head;
+    block->size = size;
+    block->used = 0;
+    block->mapped = 0;
+    this->head = block;
+    return block;
+}
+
+/**
+ * Allocates memory from the current block, starting a new block if there is
+ * not enough room left in it
+ * \param bytes the number of bytes required
+ * \param align the required alignment, which must be a power of 2
+ * \return the allocated memory
+ */
+void *Arena::allocate(size_t bytes, size_t align) {
+    Block  *block = this->head;
+    size_t  offset = 0;
+
+    if (block != nullptr)
+        offset = (block->used + align - 1) & ~(align - 1);
+    if (block == nullptr || offset + bytes > block->size) {
+        // The block header is a multiple of the largest alignment we need, so
+        // the start of a fresh block is always suitably aligned
+        block = addBlock(bytes);
+        offset = 0;
+    }
+    block->used = offset + bytes;
+    this->total += bytes;
+    return (char *)(block + 1) + offset;
+}
+
+/**
+ * Copies a string into the arena
+ * \param str the string to copy
+ * \return a view of the copy, valid until the arena is reset
+ */
+string_view Arena::copy(string_view str) {
+    char *buf = allocateArray<char>(str.size());
+
+    memcpy(buf, str.data(), str.size());
+    return string_view(buf, str.size());
+}
+
+/**
+ * Ties the lifetime of some outside resource, such as a mapped file which
+ * arena objects point into, to the arena
+ * \param resource the resource to hold onto
+ */
+void Arena::retain(shared_ptr<void> resource) {
+    this->retained.push_back(std::move(resource));
+}
+
+/**
+ * Takes ownership of every block and retained resource belonging to `other`,
+ * leaving it empty. Anything allocated from `other` then lives as long as this
+ * arena does. The blocks are spliced in behind the current block, so this
+ * arena carries on allocating from where it was.
+ *
+ * \param other the arena to take over
+ */
+void Arena::adopt(Arena &other) {
+    Block *tail;
+
+    if (other.head != nullptr) {
+        if (this->head == nullptr) {
+            this->head = other.head;
+        } else {
+            for (tail = other.head; tail->next != nullptr; tail = tail->next)
+                ;
+            tail->next = this->head->next;
+            this->head->next = other.head;
+        }
+    }
+    for (shared_ptr<void> &resource : other.retained)
+        this->retained.push_back(std::move(resource));
+    this->total += other.total;
+
+    other.head = nullptr;
+    other.retained.clear();
+    other.total = 0;
+}
+
+/**
+ * Frees every block, whether it came from the heap or a mapping, along with
+ * any retained resources
+ */
+void Arena::release() {
+    Block *block;
+
+    while (this->head != nullptr) {
+        block = this->head;
+        this->head = block->next;
+#ifndef _WIN32
+        if (block->mapped != 0) {
+            munmap(block, block->mapped);
+            continue;
+        }
+#endif // !_WIN32
+        free(block);
+    }
+    this->retained.clear();
+    this->total = 0;
+}
+
+/**
+ * Releases every block at once, along with any retained resources. Anything
+ * that was allocated from the arena is invalid after this. A mapped arena
+ * carries on mapping its blocks, from a new scratch file; the old one is not
+ * truncated, as an arena which adopted some of its blocks may still be using
+ * them, and it goes away with the last of its mappings.
+ */
+void Arena::reset() {
+    release();
+    if (this->backing >= 0)
+        openBacking();
+}
+
+/**
+ * Maps every block allocated from now on from a scratch file rather than
+ * taking it from the heap. The file is unlinked as soon as it is created, so
+ * nothing is left behind however the program exits. Blocks which have already
+ * been allocated stay where they are. This does nothing on systems without
+ * mmap, where the blocks always come from the heap.
+ * \param path where to create the scratch file
+ * \throws runtime_error if the file cannot be created
+ */
+void Arena::mapTo(const string &path) {
+#ifndef _WIN32
+    this->backingPath = path;
+    openBacking();
+#endif // !_WIN32
+}
+
+/**
+ * Replaces the scratch file with a new, empty one at `backingPath`
+ * \throws runtime_error if the file cannot be created
+ */
+void Arena::openBacking() {
+#ifndef _WIN32
+    if (this->backing >= 0)
+        ::close(this->backing);
+    this->backingSize = 0;
+    this->backing = ::open(this->backingPath.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (this->backing < 0)
+        throw runtime_error("Unable to create " + this->backingPath);
+    unlink(this->backingPath.c_str());
+#endif // !_WIN32
+}
+
+/**
+ * Getter
+ * \return the number of bytes handed out since the last reset
+ */
+size_t Arena::getSize() {
+    return this->total;
+}
+
+/**
+ * Represents a course by its course number, packed into 64-bit words. The
+ * course id numbers we were given are 7 characters, so 7 bytes plus a null
+ * byte is 8 bytes, or a single 64 bit int, but other catalogs use longer
+ * numbers. The width is a template parameter, which sets how many words the
+ * key needs at compile time, so a catalog of 7 or 8 character numbers still
+ * compares and hashes as one integer and a wider one costs one more word per
+ * 8 characters, with no branching on the width at runtime. This is the primary
+ * key for the index, the prerequisite lists and the prerequisite hash table.
+ *
+ * The characters are packed most significant first, with any unused low bytes
+ * left as zero. That makes comparing two keys word by word give exactly the
+ * same answer as comparing the strings, so every comparison in the tree is an
+ * integer compare per word, and hashing can treat the key as if it were already
+ * a number. (This used to be a union of `char[8]` and `u_int64_t`, but on a
+ * little-endian machine the integer view of that union does not sort in the
+ * same order as the string.)
+ */
+template <size_t Width>
+struct BasicCourseKey {
+    static_assert(Width > 0, "a course number needs at least one character");
+
+    static const size_t WIDTH = Width;           //! The number of characters in a course number
+    static const size_t WORDS = (Width + 7) / 8; //! The number of words they are packed into
+
+    u_int64_t words[WORDS];
+
     /**
-     * An anonymous union which can represent this course by courseId string
-     * or as an unsigned 64-bit integer. Conveniently, the course id numbers
-     * are 7 digits, so 7 bytes plus null byte is 8 bytes, or a 64 bit int. This
-     * eneables simple hashing, as we can just treat the data held by the string
-     * as if it were already a number and just hash that using modulo.
+     * Constructor
      */
-    union {
-        char      courseId[8];
-        u_int64_t num;
-    };
+    BasicCourseKey() {
+        this->clear();
+    }
 
     /**
-     * Constructor
+     * Constructor, which loads the given courseId string
      */
-    Prerequisite() {
-        this->num = 0;
+    explicit BasicCourseKey(string_view id) {
+        this->load(id);
     }
 
     /**
      * Clears the data held by the structure
      */
     void clear() {
-        this->num = 0;
+        size_t w;
+
+        for (w = 0; w < WORDS; w++)
+            this->words[w] = 0;
+    }
+
+    /**
+     * Gets how far the `i`th character is shifted up within its word
+     */
+    static unsigned shift(size_t i) {
+        return 8 * (7 - i % 8);
+    }
+
+    /**
+     * Loads the given courseId string into the structure. Only the first
+     * `WIDTH` characters are used.
+     */
+    void load(string_view id) {
+        size_t i;
+
+        this->clear();
+        for (i = 0; i < WIDTH && i < id.size(); i++)
+            this->words[i / 8] |= (u_int64_t)(unsigned char)id[i] << shift(i);
+    }
+
+    /**
+     * Loads a course number the way a person might type it, in any case and
+     * with spaces or dashes in it, such as "csci 200" for CSCI200
+     * \param text the course number as typed
+     * \param key filled in with the course number
+     * \return false if `text` does not hold exactly `WIDTH` other characters
+     */
+    static bool normalize(string_view text, BasicCourseKey &key) {
+        char   buf[WIDTH];
+        size_t n = 0;
+
+        for (char c : text) {
+            if (c == ' ' || c == '-' || c == '\t' || c == '\r')
+                continue;
+            if (n == WIDTH)
+                return false;
+            buf[n++] = (char)toupper((unsigned char)c);
+        }
+        if (n != WIDTH)
+            return false;
+        key.load(string_view(buf, n));
+        return true;
+    }
+
+    /**
+     * Builds the largest key which starts with `prefix`, by filling in every
+     * character after the prefix with the highest possible value. Together
+     * with `CourseKey(prefix)`, which is the smallest, this gives the range of
+     * keys which start with the prefix.
+     * \param prefix the start of a course number, at most `WIDTH` characters
+     * \return the last key starting with `prefix`
+     */
+    static BasicCourseKey upperBound(string_view prefix) {
+        BasicCourseKey key(prefix);
+        size_t         i;
+
+        for (i = prefix.size(); i < WIDTH; i++)
+            key.words[i / 8] |= (u_int64_t)0xff << shift(i);
+        return key;
     }
 
     /**
-     * Loads the given courseId string into the structure
+     * Hashes the value for insertion into a hash table. The words are folded
+     * together, and the result run through the MurmurHash3 finalizer, which
+     * spreads every input bit across the whole output so that ids sharing a
+     * department prefix do not land next to each other. `idx` is then added
+     * for linear probing, and the result masked down to the table capacity,
+     * which must be a power of 2.
      */
-    void load(string id) {
-        id.copy(this->courseId, 7);
+    u_int64_t hash(u_int64_t idx, u_int64_t cap) const {
+        u_int64_t h = this->words[0];
+        size_t    w;
+
+        for (w = 1; w < WORDS; w++)
+            h = h * 0x9e3779b97f4a7c15ULL ^ this->words[w];
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return (h + idx) & (cap - 1);
     }
 
     /**
-     * Hashes the value for insertion into a hash table. We access the union as
-     * a 64 bit unsigned integer, add `idx` and take the modulo of that value and
-     * the table capacity
+     * Unpacks the characters into `out`, which must have room for `WIDTH`
+     * characters. No null terminator is written.
+     * \return the number of characters written
      */
-    u_int64_t hash(u_int64_t idx, u_int64_t cap) {
-        return (this->num + idx) % cap;
+    size_t write(char *out) const {
+        size_t i;
+
+        for (i = 0; i < WIDTH; i++) {
+            out[i] = (char)(this->words[i / 8] >> shift(i));
+            if (out[i] == '\0')
+                break;
+        }
+        return i;
     }
 
     /**
      * Converts the data back into a c++ `string`
      */
-    string getString() {
-        // Create a new string from the union, accessed as a byte array
-        string out(this->courseId);
-        return out;
+    string getString() const {
+        char buf[WIDTH];
+
+        return string(buf, this->write(buf));
+    }
+
+    bool empty() const {
+        size_t w;
+
+        for (w = 0; w < WORDS; w++) {
+            if (this->words[w] != 0)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * Compares two keys a word at a time, most significant first. Only the
+     * last word is compared for the order, every word before it only has to
+     * be equal, so a single word key is a single integer compare.
+     */
+    bool operator<(const BasicCourseKey &other) const {
+        size_t w;
+
+        for (w = 0; w + 1 < WORDS; w++) {
+            if (this->words[w] != other.words[w])
+                return this->words[w] < other.words[w];
+        }
+        return this->words[w] < other.words[w];
+    }
+
+    bool operator==(const BasicCourseKey &other) const {
+        size_t w;
+
+        for (w = 0; w < WORDS; w++) {
+            if (this->words[w] != other.words[w])
+                return false;
+        }
+        return true;
+    }
+
+    bool operator!=(const BasicCourseKey &other) const { return !(*this == other); }
+    bool operator<=(const BasicCourseKey &other) const { return !(other < *this); }
+};
+
+/**
+ * The course number of this build, which is `COURSE_KEY_WIDTH` characters
+ */
+typedef BasicCourseKey<COURSE_KEY_WIDTH> CourseKey;
+
+/**
+ * Writes a course number to a stream without building a temporary string
+ */
+ostream &operator<<(ostream &out, const CourseKey &key) {
+    char buf[CourseKey::WIDTH];
+
+    return out.write(buf, key.write(buf));
+}
+
+struct Course;
+
+/**
+ * An entry in the prerequisites hash table. Each distinct prerequisite course
+ * number is looked up in the index once, and the result is stored alongside the
+ * key so that every course which names it can be linked to it directly.
+ */
+struct Prerequisite {
+    CourseKey     key;    //! The prerequisite's course number
+    const Course *course; //! The matching course, once resolved, or NULL
+
+    /**
+     * Constructor
+     */
+    Prerequisite() {
+        this->course = nullptr;
     }
 
-    bool empty() {
-        return this->num == 0 ? true : false;
+    bool empty() const {
+        return this->key.empty();
     }
 };
 
 /**
  * A simple hash table containing a list of prerequisites. This table uses open addressing
- * and a simple modulo-based hash. The chief benefit over using an array or vector
+ * with linear probing. The chief benefit over using an array or vector
  * is that we avoid duplicates, otherwise each duplicate would cause another tree
  * traversal when validating the list of prerequisites. Admittedly, there is minimal
  * benefit with such a small tree, but the larger the tree the more benefit.
  */
 class PrereqHashTable {
     private:
-        u_int64_t     len;      //! The number of elements currently in use
-        u_int64_t     capacity; //! The total number of elements which can be stored
-        Prerequisite *items;    //! A dynamically allocated array used to store the elements
+        u_int64_t     len;        //! The number of elements currently in use
+        u_int64_t     capacity;   //! The total number of elements which can be stored
+        double        loadFactor; //! The fraction of `capacity` which may be used before growing
+        u_int64_t     resizes;    //! The number of times the table has grown
+        Prerequisite *items;      //! A dynamically allocated array used to store the elements
+
+        void grow();              //! Doubles the capacity and rehashes every element
 
     public:
         PrereqHashTable();              //! Constructor
         PrereqHashTable(u_int64_t cap); //! Constructor, with capacity specifier
+        PrereqHashTable(u_int64_t cap, double loadFactor); //! Constructor, with load factor
         virtual ~PrereqHashTable();     //! Destructor
         u_int64_t getCapacity();        //! Getter for the `capacity` property
+        u_int64_t getLength();          //! Getter for the `len` property
+        double    getLoadFactor();      //! Getter for the `loadFactor` property
+        u_int64_t getResizes();         //! Getter for the `resizes` property
+        void      getProbeLengths(vector<u_int64_t> &histogram); //! Counts the entries
+                                        //! found after each number of probes
         Prerequisite *getItems();       //! Getter for the `items` field
-        void insert(string courseId);   //! Inserts a new course ID
+        void insert(CourseKey courseId); //! Inserts a new course ID
+        Prerequisite *find(CourseKey courseId); //! Finds the entry for a course ID
+        void clear();                   //! Removes every entry
 };
 
 /**
@@ -155,18 +928,40 @@ PrereqHashTable::PrereqHashTable() {
     // Just zero everything
     this->capacity = 0;
     this->len = 0;
+    this->loadFactor = DEFAULT_PREREQUISITE_LOAD_FACTOR;
+    this->resizes = 0;
     this->items = nullptr;
 }
 
 /**
  * Constructor which also sets the capacity and allocates the internal array
- * \param cap The capacity to allocate
+ * \param cap The capacity to allocate, rounded up to the next power of 2
+ * \throws invalid_argument if `cap` is over `MAX_PREREQUISITE_TABLE_SIZE`
  */
 PrereqHashTable::PrereqHashTable(u_int64_t cap) : PrereqHashTable() {
-    // Set capacity to `cap`
-    this->capacity = cap;
-    // Allocate the internal array with size `cap`
-    this->items = new Prerequisite[cap];
+    // Past 2^63 there is no power of 2 to round up to, and the loop below would
+    // never end
+    if (cap > MAX_PREREQUISITE_TABLE_SIZE)
+        throw invalid_argument("Table size must be at most "
+                + to_string(MAX_PREREQUISITE_TABLE_SIZE));
+    // Set capacity to the smallest power of 2 which holds `cap`
+    this->capacity = 1;
+    while (this->capacity < cap)
+        this->capacity <<= 1;
+    // Allocate the internal array
+    this->items = new Prerequisite[this->capacity];
+}
+
+/**
+ * Constructor which sets both the initial capacity and the load factor
+ * \param cap The capacity to allocate, rounded up to the next power of 2
+ * \param loadFactor the fraction of the capacity which may be filled before
+ * the table grows, between 0 and 1
+ */
+PrereqHashTable::PrereqHashTable(u_int64_t cap, double loadFactor) : PrereqHashTable(cap) {
+    if (!(loadFactor > 0.0 && loadFactor < 1.0))
+        throw invalid_argument("Load factor must be between 0 and 1");
+    this->loadFactor = loadFactor;
 }
 
 /**
@@ -187,141 +982,446 @@ u_int64_t PrereqHashTable::getCapacity() {
 
 /**
  * Getter
- * \return the internal array of items
+ * \return the number of prerequisites stored in this structure
  */
-Prerequisite* PrereqHashTable::getItems() {
-    return this->items;
+u_int64_t PrereqHashTable::getLength() {
+    return this->len;
 }
 
 /**
- * Inserts a new course ID number into the table
- * \param courseId the course ID number to insert
+ * Getter
+ * \return the fraction of the capacity which may be filled before growing
  */
-void PrereqHashTable::insert(string courseId) {
-    Prerequisite prereq;
-    u_int32_t    hash;
-    u_int32_t    idx;
+double PrereqHashTable::getLoadFactor() {
+    return this->loadFactor;
+}
 
-    // Load the string into the `Prerequisite` union (treating it as a byte array)
-    prereq.load(courseId);
+/**
+ * Getter
+ * \return the number of times the table has doubled in size
+ */
+u_int64_t PrereqHashTable::getResizes() {
+    return this->resizes;
+}
 
-    // Iterate for the full capacity, in case of hash collisions
-    for (idx = 0; idx < this->capacity; idx++) {
-        // Hash the prerequisite
-        hash = prereq.hash(idx, this->capacity);
+/**
+ * Builds a histogram of how many probes it takes to find each entry, where
+ * `histogram[i]` is the number of entries found on probe i + 1. A long tail
+ * means that keys are clustering.
+ * \param histogram filled in with the count for each probe length
+ */
+void PrereqHashTable::getProbeLengths(vector<u_int64_t> &histogram) {
+    u_int64_t i;
+    u_int64_t idx;
+
+    histogram.clear();
+    for (i = 0; i < this->capacity; i++) {
+        if (this->items[i].empty())
+            continue;
+        for (idx = 0; this->items[i].key.hash(idx, this->capacity) != i; idx++)
+            ;
+        if (histogram.size() <= idx)
+            histogram.resize(idx + 1);
+        histogram[idx]++;
+    }
+}
+
+/**
+ * Getter
+ * \return the internal array of items
+ */
+Prerequisite* PrereqHashTable::getItems() {
+    return this->items;
+}
+
+/**
+ * Inserts a new course ID number into the table
+ * \param prereq the course ID number to insert
+ */
+void PrereqHashTable::insert(CourseKey prereq) {
+    u_int64_t hash;
+    u_int64_t idx;
+
+    /* Make sure there will be room for one more before probing. Because the
+     * table is never allowed to fill up there is always an empty slot, so the
+     * loop below is guaranteed to terminate */
+    if (this->len + 1 > this->capacity * this->loadFactor)
+        this->grow();
+
+    // Probe until we find either a match or an empty slot
+    for (idx = 0; ; idx++) {
+        // Hash the prerequisite
+        hash = prereq.hash(idx, this->capacity);
 
         // If we find a match, just break and exit. Nothing to do, we don't want
         // duplicates anyway.
-        if (this->items[hash].num == prereq.num) {
+        if (this->items[hash].key == prereq) {
             break;
-        } else if (this->items[hash].num == 0) {
+        } else if (this->items[hash].empty()) {
             // Found an empty slot, copy the data to the item at this index
-            this->items[hash].num = prereq.num;
+            this->items[hash].key = prereq;
+            this->len++;
             break;
         }
     }
 }
 
+/**
+ * Finds the entry for a course ID number
+ * \param courseId the course ID number to look for
+ * \return the entry, or NULL if the course ID was never inserted
+ */
+Prerequisite *PrereqHashTable::find(CourseKey courseId) {
+    u_int64_t hash;
+    u_int64_t idx;
+
+    if (this->capacity == 0)
+        return nullptr;
+    // There is always at least one empty slot, which ends the probe
+    for (idx = 0; ; idx++) {
+        hash = courseId.hash(idx, this->capacity);
+        if (this->items[hash].key == courseId)
+            return &this->items[hash];
+        else if (this->items[hash].empty())
+            return nullptr;
+    }
+}
+
+/**
+ * Empties the table, keeping its current capacity
+ */
+void PrereqHashTable::clear() {
+    u_int64_t i;
+
+    for (i = 0; i < this->capacity; i++)
+        this->items[i] = Prerequisite();
+    this->len = 0;
+}
+
+/**
+ * Doubles the capacity of the table. Every element has to be rehashed, as its
+ * position depends on the capacity.
+ */
+void PrereqHashTable::grow() {
+    Prerequisite *old = this->items;
+    u_int64_t     oldCapacity = this->capacity;
+    u_int64_t     i;
+    u_int64_t     idx;
+    u_int64_t     hash;
+
+    this->capacity = oldCapacity == 0 ? 1 : oldCapacity * 2;
+    this->items = new Prerequisite[this->capacity];
+    this->resizes++;
+
+    for (i = 0; i < oldCapacity; i++) {
+        if (old[i].empty())
+            continue;
+        // No duplicates can exist, so just find the first empty slot
+        for (idx = 0; ; idx++) {
+            hash = old[i].key.hash(idx, this->capacity);
+            if (this->items[hash].empty()) {
+                this->items[hash] = old[i];
+                break;
+            }
+        }
+    }
+    delete[] old;
+}
+
+/**
+ * Finds the commas in a line of csv data and where the line ends, 16 bytes at
+ * a time. Each block is compared against ',' and '\n' all at once with SSE2 or
+ * AArch64 NEON, giving one bit per byte for each, so a block with no delimiters in it
+ * costs a couple of instructions and each delimiter in it costs one more. Any
+ * other target, and the last few bytes of the data, are scanned one byte at a
+ * time.
+ */
+class CsvScanner {
+    private:
+        static const size_t BLOCK = 16; // bytes compared at a time
+
+        /**
+         * Gets the position of the lowest set bit
+         * \param mask a non-zero mask
+         * \return the position, counting from 0
+         */
+        static unsigned lowestBit(u_int32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+            return (unsigned)__builtin_ctz(mask);
+#else
+            unsigned bit = 0;
+
+            while ((mask & 1) == 0) {
+                mask >>= 1;
+                bit++;
+            }
+            return bit;
+#endif // __GNUC__ || __clang__
+        }
+
+#ifdef CSV_SCAN_SIMD
+        /**
+         * Compares a block of bytes against `c`
+         * \param block the first of `BLOCK` bytes
+         * \param c the byte to look for
+         * \return a mask with bit i set where `block[i]` is `c`
+         */
+        static u_int32_t match(const char *block, char c) {
+#if defined(__SSE2__)
+            __m128i bytes = _mm_loadu_si128((const __m128i *)block);
+
+            return (u_int32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+#else
+            // NEON has no movemask, so weight each lane by its bit and add them up
+            static const uint8_t weights[BLOCK] = {
+                1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+            };
+            uint8x16_t bits = vandq_u8(vceqq_u8(vld1q_u8((const uint8_t *)block),
+                    vdupq_n_u8((uint8_t)c)), vld1q_u8(weights));
+
+            return (u_int32_t)vaddv_u8(vget_low_u8(bits))
+                | (u_int32_t)vaddv_u8(vget_high_u8(bits)) << 8;
+#endif // __SSE2__
+        }
+#endif // CSV_SCAN_SIMD
+
+    public:
+        /**
+         * Scans the line at the start of `data`
+         * \param data the csv data, starting at the beginning of a line
+         * \param commas filled in with the position of every comma in the line
+         * \return the length of the line, not counting its line feed
+         */
+        static size_t scanLine(string_view data, vector<u_int32_t> &commas) {
+            const char *start = data.data();
+            const char *end = start + data.size();
+            const char *p = start;
+
+            commas.clear();
+#ifdef CSV_SCAN_SIMD
+            for (; end - p >= (ptrdiff_t)BLOCK; p += BLOCK) {
+                u_int32_t lines = match(p, '\n');
+                u_int32_t found = match(p, ',');
+
+                // Only the commas before the line feed belong to this line
+                if (lines != 0)
+                    found &= (lines & (0 - lines)) - 1;
+                for (; found != 0; found &= found - 1)
+                    commas.push_back((u_int32_t)(p - start + lowestBit(found)));
+                if (lines != 0)
+                    return p - start + lowestBit(lines);
+            }
+#endif // CSV_SCAN_SIMD
+            for (; p < end && *p != '\n'; p++) {
+                if (*p == ',')
+                    commas.push_back((u_int32_t)(p - start));
+            }
+            return p - start;
+        }
+};
+
+/**
+ * A single course. The course number and prerequisites are packed `CourseKey`s,
+ * with the prerequisites held as a flat array of keys. The title is copied
+ * into an `Arena` when the course is parsed, and the prerequisites array is
+ * allocated from the same arena. That makes a `Course` a handful of words which
+ * can be copied or moved around freely, but it is only valid for as long as the
+ * arena it was parsed into.
+ *
+ * Once the whole catalog has been loaded each prerequisite is resolved to the
+ * course it names, and `prerequisiteLinks[i]` points straight at the course
+ * for `prerequisites[i]`. Following a prerequisite is then just a pointer
+ * dereference rather than another search of the index. The link array lives
+ * in the arena rather than in the course itself, which is what allows it to be
+ * filled in after the course has been moved into the index.
+ */
 struct Course {
-    string         number;
-    string         title;
-    vector<string> prerequisites;
+    CourseKey                 number;
+    string_view               title;
+    ArenaArray<CourseKey>     prerequisites;
+    ArenaArray<const Course*> prerequisiteLinks;
+    mutable u_int32_t         id = 0; // Position in the catalog's prerequisite order, which is
+                                      // assigned once the catalog has been loaded
 
     // Clears all of the fields
     void clear() {
+        id = 0;
         number.clear();
-        title.clear();
-        prerequisites.clear();
+        title = string_view();
+        prerequisites = ArenaArray<CourseKey>();
+        prerequisiteLinks = ArenaArray<const Course*>();
     }
 
     /**
      * Initializes this Course with the data from a line of text read from the
-     * CSV file.
+     * CSV file, whose commas have already been found by `CsvScanner`. The
+     * fields are the gaps between the commas, so nothing is scanned again: the
+     * course numbers are packed into keys, and only the title is copied into
+     * `arena`.
      *
      * \param line the line of text from which to parse the data
+     * \param commas the position of every comma in `line`
      * \param table a temporary hash table to track course prerequisites
+     * \param arena the arena in which the course's data will be stored
      */
-    void init(string line, PrereqHashTable *table) {
-        char delim = ',';
-        stringstream stream(line);
-
-        // Use getline with a comma delimiter to read the first field
-        getline(stream, number, delim);
-        /* We know that all course numbers are 7 characters long. Anything else
-         * is invalid input, so throw an exception
+    void init(string_view line, const vector<u_int32_t> &commas, PrereqHashTable *table,
+            Arena *arena) {
+        size_t start;
+        size_t end;
+        size_t i;
+
+        /* The joys of cross-platform line endings. MS uses cr/lf, so if the
+         * CSV file was created in Windows but processed on some Unix(ish)
+         * system the line will still have a carriage return on the end. Drop
+         * it before splitting so that it ends up in none of the fields. Every
+         * comma comes before it, so their positions are unaffected.
+         */
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+
+        /* The first field is the course number. We know that all course
+         * numbers are `WIDTH` characters long, which means the first comma has
+         * to come straight after them. Anything else is invalid input, so
+         * throw an exception
          */
-        if (number.size() != 7) {
+        end = commas.empty() ? line.size() : commas[0];
+        if (end != CourseKey::WIDTH) {
             this->clear();
             throw runtime_error("Error: invalid course number");
         }
+        number.load(line.substr(0, end));
 
-        /**
-         * Again, use getline with a comma delimiter to read the field
-         */
-        getline(stream, title, delim);
+        // The second field is the title
+        start = end + 1;
+        end = commas.size() < 2 ? line.size() : commas[1];
         // Assume any string is a valid title, unless it is emopty
-        if (title.empty()) {
+        if (start >= end) {
             this->clear();
             throw runtime_error("Error: empty course title");
         }
+        title = arena->copy(line.substr(start, end - start));
 
-        // Read prerequisites until the end of the line
-        while (!stream.eof()) {
-            string pr;
+        /* Every remaining comma starts another field, so that is an upper bound
+         * on the number of prerequisites. A few slots may go unused when there
+         * are trailing commas, but it means the list can be allocated up front */
+        size_t maxPrerequisites = commas.size() < 2 ? 0 : commas.size() - 1;
+        prerequisites.size = 0;
+        prerequisites.data = arena->allocateArray<CourseKey>(maxPrerequisites);
 
-            getline(stream, pr, delim);
+        // Read prerequisites until the end of the line
+        for (i = 1; i < commas.size(); i++) {
+            start = commas[i] + 1;
+            end = i + 1 < commas.size() ? commas[i + 1] : line.size();
 
-            /* The joys of cross-platform line endings. MS uses cr/lf, so if the
-             * CSV file was created in Windows but processed on some Unix(ish)
-             * system we will get a final string which is made up of just a
-             * carriage return character. So we handle either that case or the
-             * case of an empty string
-             */
-            if ((pr.size() == 1 && pr[0] == '\r') || pr.empty()) {
+            // Trailing commas leave empty fields, which are just skipped
+            if (start >= end)
                 continue;
-            } else {
-                // Add `pr` to both this Course structure and the temporary hash table
-                prerequisites.push_back(pr);
-                table->insert(pr);
-            }
+            // Add the field to both this Course structure and the temporary hash table
+            prerequisites.data[prerequisites.size] = CourseKey(line.substr(start, end - start));
+            table->insert(prerequisites.data[prerequisites.size++]);
         }
+
+        // The links are filled in later, once every course has been loaded
+        prerequisiteLinks.size = prerequisites.size;
+        prerequisiteLinks.data = arena->allocateArray<const Course*>(prerequisites.size);
+        fill(prerequisiteLinks.begin(), prerequisiteLinks.end(), nullptr);
     }
 
     /**
-     * Display the basic info, used for listing all courses
+     * Copies this course's data into another arena, so that it no longer
+     * depends on the arena it was parsed into. The links are left unresolved.
+     * \param arena where the course's data will be stored from now on
      */
-    void display() {
-        cout << number << ", " << title << endl;
+    void relocate(Arena *arena) {
+        CourseKey *keys = arena->allocateArray<CourseKey>(prerequisites.size);
+
+        title = arena->copy(title);
+        copy(prerequisites.begin(), prerequisites.end(), keys);
+        prerequisites.data = keys;
+        prerequisiteLinks.size = prerequisites.size;
+        prerequisiteLinks.data = arena->allocateArray<const Course*>(prerequisites.size);
+        fill(prerequisiteLinks.begin(), prerequisiteLinks.end(), nullptr);
     }
 
     /**
-     * Display a more detailed course listing, with prerequisites
+     * Renders the basic info, used for listing all courses, onto the end of
+     * `out`. Rendering into a buffer lets a caller which is printing a lot of
+     * courses write them all out in one go.
+     */
+    void render(string &out) const {
+        char buf[CourseKey::WIDTH];
+
+        out.append(buf, number.write(buf));
+        out += ", ";
+        out += title;
+        out += '\n';
+    }
+
+    /**
+     * Renders a more detailed course listing, with prerequisites, onto the end
+     * of `out`
      */
-    void displayDetails() {
+    void renderDetails(string &out) const {
+        char buf[CourseKey::WIDTH];
         bool comma = false;
 
-        // Display the basic info
-        this->display();
+        // Render the basic info
+        this->render(out);
 
         // Skip if no prerequisites
         if (!prerequisites.empty()) {
-            cout << "Prerequisites:";
-            for (string c : prerequisites) {
+            out += "Prerequisites:";
+            for (const CourseKey &c : prerequisites) {
                 // `comma` will only be false on the first iteration
-                if (comma)
-                    cout << ", " << c;
-                else
-                    cout << " " << c;
+                out += comma ? ", " : " ";
+                out.append(buf, c.write(buf));
                 comma = true;
             }
-            cout << endl;
+            out += '\n';
+        }
+    }
+
+    /**
+     * Display the basic info, used for listing all courses
+     */
+    void display(ostream &out = cout) const {
+        string buf;
+
+        this->render(buf);
+        out << buf;
+    }
+
+    /**
+     * Display a more detailed course listing, with prerequisites
+     */
+    void displayDetails(ostream &out = cout) const {
+        string buf;
+
+        this->renderDetails(buf);
+        out << buf;
+    }
+
+    /**
+     * Compares everything which is loaded from the csv file
+     * \param other the course to compare with
+     * \return true if both courses have the same title and prerequisites
+     */
+    bool equals(const Course &other) const {
+        u_int32_t i;
+
+        if (title != other.title || prerequisites.size != other.prerequisites.size)
+            return false;
+        for (i = 0; i < prerequisites.size; i++) {
+            if (prerequisites[i] != other.prerequisites[i])
+                return false;
         }
+        return true;
     }
 
     /**
      * Utility function, determines if the Course structure is in use
      */
-    bool empty() {
+    bool empty() const {
         if (this->number.empty())
             return true;
         else
@@ -336,6 +1436,7 @@ struct Node {
     Course  course;
     Node   *left;
     Node   *right;
+    int     height; // height of the subtree rooted here, only maintained by the AVL tree
 
     /**
      * Constructor
@@ -344,45 +1445,225 @@ struct Node {
         // Just set both children to NULL
         left = nullptr;
         right = nullptr;
+        height = 1;
     }
 
     /**
-     * Constructor
+     * Constructor, which takes ownership of the course's data rather than
+     * copying it
      */
-    Node(Course course) : Node() {
-        this->course = course;
+    Node(Course &&course) : Node() {
+        this->course = std::move(course);
     }
 
-    /**
-     * Destructor
-     */
-    virtual ~Node() {
-        // Recursively delete all children
-        delete left;
-        delete right;
-    }
+    // Nodes live in the tree's `Arena`, so there is no destructor. Their memory
+    // is released along with everything else when the arena is reset.
+};
+
+/**
+ * An enum representing the available index engines
+ */
+typedef enum {
+    IndexBST       = 1,
+    IndexAVL       = 2,
+    IndexEytzinger = 3,
+}   IndexEngine;
+
+/**
+ * The shape of an index, for spotting degenerate trees
+ */
+struct IndexStats {
+    size_t nodes        = 0; // the number of courses
+    size_t height       = 0; // the most nodes on any path down from the root
+    double averageDepth = 0; // the mean number of nodes a successful search visits
+};
+
+/**
+ * The interface shared by every index engine. The rest of the program only
+ * talks to the course index through these methods, so that the engine can be
+ * swapped out without touching the `Driver`.
+ *
+ * Courses are moved into the index and never copied back out again. `Search`
+ * hands back a pointer to the course held by the index (or NULL), which stays
+ * valid until the index is drained or rebuilt, or that course is removed.
+ * Courses never move once they are in the index: `Remove` and `Update` leave
+ * every other course where it was, which is what keeps the links between
+ * courses valid across them.
+ */
+class CourseIndex {
+    protected:
+        Arena arena; //! The per-load arena where the courses' data is stored
+
+    public:
+        typedef function<void(const Course &)> Visitor; //! Called for each course in a traversal
+
+        static const size_t OUTPUT_BUFFER_SIZE = 64 * 1024; //! Output is written in chunks this big
+        static const size_t SEARCH_GROUP = 8; //! Searches `SearchMany` keeps in flight at once
+
+    protected:
+        static void print(ostream &out, const function<void(const Visitor &)> &traverse);
+
+    public:
+
+        virtual ~CourseIndex() {}
+        Arena *getArena() { return &arena; } //! Getter for the `arena` field
+        virtual size_t        getMemoryUsed() { return arena.getSize(); } //! Bytes held
+                                                   //! in the index's arenas
+        virtual void          mapArena(const string &path) { arena.mapTo(path); } //! Maps
+                                                   //! the index's memory from scratch files
+        void                  InOrder(ostream &out) const; //! Prints every course in order
+        size_t                PrintRange(CourseKey lo, CourseKey hi, ostream &out) const; //! Prints
+                                                                   //! the courses in [lo, hi]
+        void                  Prefix(string_view prefix, const Visitor &visit) const; //! Visits
+                                                                   //! the courses starting with `prefix`
+        virtual void          Range(CourseKey lo, CourseKey hi, const Visitor &visit) const = 0;
+        virtual void          drain() = 0;
+        virtual void          ForEach(const Visitor &visit) const = 0;
+        virtual void          Insert(Course &&course) = 0;
+        virtual bool          Remove(CourseKey courseNumber) = 0;
+        virtual bool          Update(Course &&course) = 0;
+        virtual const Course *Search(CourseKey courseNumber) const = 0;
+        virtual void          SearchMany(const CourseKey *courseNumbers, size_t count,
+                                      const Course **results) const; //! Searches for a batch
+        virtual bool          Exists(CourseKey courseNumber) const = 0;
+        virtual void          Build(vector<Course> &courses) = 0;
+        virtual IndexStats    getStats() const = 0; //! Measures the shape of the index
+        virtual const char   *getName() const = 0;  //! The engine's name on the command line
+        virtual bool          isReadOnly() const { return false; } //! Whether the index can
+                                                   //! only be filled by `Build`
+
+        static CourseIndex *create(IndexEngine engine); //! Factory
 };
 
+/**
+ * Prints the basic info for each course visited by a traversal. Rather than
+ * writing each course to `out` separately the listing is rendered into a
+ * buffer which is handed to the stream in large chunks, and the stream is only
+ * flushed once at the very end.
+ *
+ * \param out the stream to print to
+ * \param traverse runs the traversal, calling its argument for each course
+ */
+void CourseIndex::print(ostream &out, const function<void(const Visitor &)> &traverse) {
+    string buffer;
+
+    buffer.reserve(OUTPUT_BUFFER_SIZE);
+    traverse([&](const Course &course) {
+        course.render(buffer);
+        if (buffer.size() >= OUTPUT_BUFFER_SIZE) {
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    });
+    out.write(buffer.data(), buffer.size());
+    out.flush();
+}
+
+/**
+ * Searches for a batch of courses at once. This version just searches for each
+ * in turn; the engines override it to interleave the searches, so that the
+ * memory loads of several of them are waiting on the cache at the same time
+ * rather than one after another.
+ * \param courseNumbers the course numbers to look for
+ * \param count the number of course numbers
+ * \param results filled in with the matching course for each number, or NULL
+ */
+void CourseIndex::SearchMany(const CourseKey *courseNumbers, size_t count,
+        const Course **results) const {
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        results[i] = this->Search(courseNumbers[i]);
+}
+
+/**
+ * Prints the basic info for every course, in alphanumeric order
+ * \param out the stream to print to
+ */
+void CourseIndex::InOrder(ostream &out) const {
+    print(out, [this](const Visitor &visit) { this->ForEach(visit); });
+}
+
+/**
+ * Prints the basic info for every course numbered from `lo` to `hi` inclusive,
+ * in alphanumeric order
+ * \param lo the first course number to include
+ * \param hi the last course number to include
+ * \param out the stream to print to
+ * \return the number of courses printed
+ */
+size_t CourseIndex::PrintRange(CourseKey lo, CourseKey hi, ostream &out) const {
+    size_t count = 0;
+
+    print(out, [&](const Visitor &visit) {
+        this->Range(lo, hi, [&](const Course &course) {
+            visit(course);
+            count++;
+        });
+    });
+    return count;
+}
+
+/**
+ * Visits every course whose number starts with `prefix`, in alphanumeric
+ * order. As keys compare in the same order as strings, these are exactly the
+ * courses between the smallest and largest keys with that prefix.
+ * \param prefix the start of a course number, at most `WIDTH` characters
+ * \param visit the function to call for each course
+ */
+void CourseIndex::Prefix(string_view prefix, const Visitor &visit) const {
+    this->Range(CourseKey(prefix), CourseKey::upperBound(prefix), visit);
+}
+
 /**
  * A Binary Search Tree for `Course` data structures, using the Course ID number
  * as the key element
  */
-class BinarySearchTree {
-    private:
+class BinarySearchTree : public CourseIndex {
+    protected:
         Node *root;
-        void  addNode(Node *node, Course course);
-        void  inOrder(Node *node);
+        Node *freeList; // Removed nodes, linked through `left`, waiting to be reused
+        Node *newNode(Course &&course);
+        void  addNode(Node *node, Course &&course);
+        void  inOrder(Node *node, const Visitor &visit) const;
+        void  inRange(Node *node, CourseKey lo, CourseKey hi, const Visitor &visit) const;
+        Node *buildRange(vector<Course> &courses, size_t lo, size_t hi);
+        Node *removeNode(Node *node, CourseKey courseNumber, Node *&removed);
+        Node *removeMin(Node *node, Node *&min);
+        virtual Node *fixup(Node *node); // Called for each node on the way back up from a removal
 
     public:
         BinarySearchTree();
         virtual ~BinarySearchTree();
-        void     drain();
-        void     InOrder();
-        void     Insert(Course course);
-        Course   Search(string courseNumber);
-        bool     Exists(string courseNumber);
+        void          drain() override;
+        void          ForEach(const Visitor &visit) const override;
+        void          Range(CourseKey lo, CourseKey hi, const Visitor &visit) const override;
+        void          Insert(Course &&course) override;
+        bool          Remove(CourseKey courseNumber) override;
+        bool          Update(Course &&course) override;
+        const Course *Search(CourseKey courseNumber) const override;
+        void          SearchMany(const CourseKey *courseNumbers, size_t count,
+                              const Course **results) const override;
+        bool          Exists(CourseKey courseNumber) const override;
+        void          Build(vector<Course> &courses) override;
+        IndexStats    getStats() const override;
+        const char   *getName() const override { return "bst"; }
 };
 
+/**
+ * Creates a new node for `course`, reusing a removed node when there is one
+ * \param course the course to be stored in the node, which is moved into it
+ * \return the new node
+ */
+Node *BinarySearchTree::newNode(Course &&course) {
+    Node *node = freeList;
+
+    if (node == nullptr)
+        return arena.create<Node>(std::move(course));
+    freeList = node->left;
+    return new (node) Node(std::move(course));
+}
+
 /**
  * Add a node to the tree as a child of `node`. Recursive function which will
  * run until the proper spot is found for insertion.
@@ -390,15 +1671,15 @@ class BinarySearchTree {
  * \param node the node under which this course should be inserted.
  * \param course the course to be inserted
  */
-void BinarySearchTree::addNode(Node *node, Course course) {
+void BinarySearchTree::addNode(Node *node, Course &&course) {
     // Case 1: this course's number is less than that of `node->course`
     if (course.number < node->course.number) {
         if (node->left == nullptr) {
             // Open spot found, insert here
-            node->left = new Node(course);
+            node->left = newNode(std::move(course));
         } else {
             // Recurse left
-            addNode(node->left, course);
+            addNode(node->left, std::move(course));
         }
     /* Case 2: this course's number is greater than that of `node->course`.
      * Technically speaking this branch would run were we to add a course with
@@ -408,31 +1689,61 @@ void BinarySearchTree::addNode(Node *node, Course course) {
     } else {
         if (node->right == nullptr) {
             // open spot found, insert here
-            node->right = new Node(course);
+            node->right = newNode(std::move(course));
         } else {
             // recurse right
-            addNode(node->right, course);
+            addNode(node->right, std::move(course));
         }
     }
 }
 
 /**
  * Recurse from `node` in alphanumeric order (a Binary Search Tree inOrder
- * traversal). Print the basic info from each course as it is visited.
+ * traversal). Call `visit` for each course as it is visited.
  *
  *\param node the node to start with
+ *\param visit the function to call for each course
  */
-void BinarySearchTree::inOrder(Node *node) {
+void BinarySearchTree::inOrder(Node *node, const Visitor &visit) const {
     // Bail on encountering a NULL node
     if (node == nullptr)
         return;
 
+    // recurse left
+    inOrder(node->left, visit);
+    // visit this course
+    visit(node->course);
     // recurse right
-    inOrder(node->left);
-    // print info
-    node->course.display();
-    // recurse right
-    inOrder(node->right);
+    inOrder(node->right, visit);
+}
+
+/**
+ * Recurse from `node` in alphanumeric order, like `inOrder`, but only into
+ * subtrees which can hold a course numbered from `lo` to `hi`. The left subtree
+ * only holds smaller numbers and the right subtree only holds larger (or equal)
+ * ones, so everything outside the range is skipped without being visited. That
+ * makes the cost O(h + k) for k matching courses, rather than O(n).
+ *
+ * \param node the node to start with
+ * \param lo the first course number to include
+ * \param hi the last course number to include
+ * \param visit the function to call for each matching course
+ */
+void BinarySearchTree::inRange(Node *node, CourseKey lo, CourseKey hi,
+        const Visitor &visit) const {
+    while (node != nullptr) {
+        // Anything smaller than lo is to the left, so only go left when this
+        // node is past the start of the range
+        if (lo < node->course.number)
+            inRange(node->left, lo, hi, visit);
+        if (lo <= node->course.number && node->course.number <= hi)
+            visit(node->course);
+        // Likewise only go right when this node is not yet past the end. This
+        // is a loop rather than a second recursive call.
+        if (hi < node->course.number)
+            return;
+        node = node->right;
+    }
 }
 
 /**
@@ -441,161 +1752,4225 @@ void BinarySearchTree::inOrder(Node *node) {
 BinarySearchTree::BinarySearchTree() {
     // empty tree, make sure `root` is set to NULL
     root = nullptr;
+    freeList = nullptr;
 }
 
 /**
  * Destructor
  */
 BinarySearchTree::~BinarySearchTree() {
-    // Since we alread have a function which will recursively call delete on
-    // the nodes, starting with this->root, just call that method */
+    // The arena releases its memory when it is destroyed, but drain anyway so
+    // that `root` is never left dangling
     drain();
 }
 
 /**
- * Recursively deletes all nodes in the tree, beginning with `root`, then sets
- * this->root equal to NULL
+ * Empties the tree by releasing the arena which holds every node and course,
+ * then sets this->root equal to NULL. This frees whole blocks at a time
+ * rather than visiting every node.
+ */
+void BinarySearchTree::drain() {
+    arena.reset();
+    root = nullptr;
+    freeList = nullptr;
+}
+
+/**
+ * Begin the inOrder tree traversal, starting with the root node
+ * \param visit the function to call for each course
+ */
+void BinarySearchTree::ForEach(const Visitor &visit) const {
+    this->inOrder(root, visit);
+}
+
+/**
+ * Begin a range traversal, starting with the root node
+ * \param lo the first course number to include
+ * \param hi the last course number to include
+ * \param visit the function to call for each matching course
+ */
+void BinarySearchTree::Range(CourseKey lo, CourseKey hi, const Visitor &visit) const {
+    this->inRange(root, lo, hi, visit);
+}
+
+/**
+ * Insert a course into the BST
+ * \param course the course to be inserted, which is moved into the tree
+ */
+void BinarySearchTree::Insert(Course &&course) {
+    if (this->root == nullptr) {
+        // Empty tree, make this the root
+        this->root = newNode(std::move(course));
+    } else {
+        // Traverse the tree to find the correct spot to insert this course
+        this->addNode(this->root, std::move(course));
+    }
+}
+
+/**
+ * Measures the shape of the tree. The walk keeps its own stack rather than
+ * recursing, as the tree being measured may well have degenerated into a list.
+ * \return the number of nodes, the height and the average depth of a node
+ */
+IndexStats BinarySearchTree::getStats() const {
+    IndexStats                       stats;
+    vector<pair<const Node*, size_t>> stack;
+    size_t                           total = 0;
+
+    if (root != nullptr)
+        stack.emplace_back(root, 1);
+    while (!stack.empty()) {
+        const Node *node = stack.back().first;
+        size_t      depth = stack.back().second;
+
+        stack.pop_back();
+        stats.nodes++;
+        total += depth;
+        stats.height = max(stats.height, depth);
+        if (node->left != nullptr)
+            stack.emplace_back(node->left, depth + 1);
+        if (node->right != nullptr)
+            stack.emplace_back(node->right, depth + 1);
+    }
+    stats.averageDepth = stats.nodes == 0 ? 0 : (double)total / stats.nodes;
+    return stats;
+}
+
+/**
+ * Does nothing, a plain BST makes no attempt to stay balanced
+ * \param node a node on the path back up from a removal
+ * \return the (unchanged) root of the subtree
+ */
+Node *BinarySearchTree::fixup(Node *node) {
+    return node;
+}
+
+/**
+ * Unlinks the leftmost node of the subtree rooted at `node`
+ * \param node the root of the subtree, which must not be NULL
+ * \param min set to the node which was unlinked
+ * \return the new root of the subtree
+ */
+Node *BinarySearchTree::removeMin(Node *node, Node *&min) {
+    if (node->left == nullptr) {
+        min = node;
+        return node->right;
+    }
+    node->left = removeMin(node->left, min);
+    return fixup(node);
+}
+
+/**
+ * Recursively unlinks the node holding `courseNumber` from the subtree rooted
+ * at `node`. A node with two children is replaced by its in-order successor.
+ * The textbook version copies the successor's course over the removed one and
+ * deletes the successor's node instead, but that would move the successor
+ * course to a new address and break every link to it, so here the successor
+ * node itself is moved into the removed node's place.
+ *
+ * \param node the root of the subtree
+ * \param courseNumber the course to remove
+ * \param removed set to the node which was unlinked, untouched if there is none
+ * \return the new root of the subtree
+ */
+Node *BinarySearchTree::removeNode(Node *node, CourseKey courseNumber, Node *&removed) {
+    Node *successor;
+    Node *right;
+
+    if (node == nullptr)
+        return nullptr;
+
+    if (courseNumber < node->course.number) {
+        node->left = removeNode(node->left, courseNumber, removed);
+    } else if (node->course.number < courseNumber) {
+        node->right = removeNode(node->right, courseNumber, removed);
+    } else {
+        removed = node;
+        // Zero or one children, the child (if any) takes this node's place
+        if (node->left == nullptr)
+            return node->right;
+        if (node->right == nullptr)
+            return node->left;
+
+        right = removeMin(node->right, successor);
+        successor->left = node->left;
+        successor->right = right;
+        return fixup(successor);
+    }
+    return fixup(node);
+}
+
+/**
+ * Removes a course from the BST. The node is kept to be reused by the next
+ * insert, as the arena cannot free anything on its own.
+ * \param courseNumber the course id number to remove
+ * \return false if there was no such course
+ */
+bool BinarySearchTree::Remove(CourseKey courseNumber) {
+    Node *removed = nullptr;
+
+    this->root = removeNode(this->root, courseNumber, removed);
+    if (removed == nullptr)
+        return false;
+
+    removed->course.clear();
+    removed->left = freeList;
+    freeList = removed;
+    return true;
+}
+
+/**
+ * Replaces the title and prerequisites of a course which is already in the
+ * BST. The course stays in the same node, so links to it remain valid.
+ * \param course the new version of the course, which is moved into the tree
+ * \return false if there was no course with a matching number
+ */
+bool BinarySearchTree::Update(Course &&course) {
+    Course *existing = const_cast<Course *>(this->Search(course.number));
+
+    if (existing == nullptr)
+        return false;
+    *existing = std::move(course);
+    return true;
+}
+
+/**
+ * Searches the BST for a course with a matching ID number
+ * \param courseNumber the course id number to look for
+ * \return the matching course, or NULL if there is none
+ */
+const Course *BinarySearchTree::Search(CourseKey courseNumber) const {
+    Node *currentNode = this->root;
+
+    // If currentNode is null, then we have traversed the entire tree without
+    // finding a match. Loop until then.
+    while (currentNode != nullptr) {
+        if (currentNode->course.number == courseNumber) {
+            // match found
+            return &currentNode->course;
+        } else {
+            // current node is not a match. If courseNumber is less, go left, if
+            // greater go right
+            currentNode = (courseNumber < currentNode->course.number) ? currentNode->left
+                : currentNode->right;
+        }
+    }
+
+    // No match found
+    return nullptr;
+}
+
+/**
+ * Searches the BST for a batch of courses. Up to `SEARCH_GROUP` searches walk
+ * down the tree together, each taking one step in turn, and each step
+ * prefetches the node that search will look at next. By the time the search
+ * comes round again its node is usually in the cache, so the tree is walked at
+ * the rate memory can deliver nodes rather than one cache miss at a time. As
+ * soon as a search finishes the next number in the batch takes its place.
+ * \param courseNumbers the course numbers to look for
+ * \param count the number of course numbers
+ * \param results filled in with the matching course for each number, or NULL
+ */
+void BinarySearchTree::SearchMany(const CourseKey *courseNumbers, size_t count,
+        const Course **results) const {
+    const Node *nodes[SEARCH_GROUP]; // where each search has got to
+    size_t      slots[SEARCH_GROUP]; // the number each search is looking for
+    size_t      active = 0;
+    size_t      next = 0;
+    size_t      i;
+
+    for (; active < SEARCH_GROUP && next < count; active++, next++) {
+        nodes[active] = root;
+        slots[active] = next;
+    }
+    while (active > 0) {
+        for (i = 0; i < active;) {
+            const Node *node = nodes[i];
+            CourseKey   courseNumber = courseNumbers[slots[i]];
+
+            // Keep walking until this search either finds a match or falls off
+            if (node != nullptr && node->course.number != courseNumber) {
+                node = courseNumber < node->course.number ? node->left : node->right;
+                PREFETCH(node);
+                nodes[i++] = node;
+                continue;
+            }
+            results[slots[i]] = node == nullptr ? nullptr : &node->course;
+            if (next < count) {
+                // Start on the next number in this search's place
+                nodes[i] = root;
+                slots[i++] = next++;
+            } else {
+                // Nothing left to start, so move the last search into its place
+                active--;
+                nodes[i] = nodes[active];
+                slots[i] = slots[active];
+            }
+        }
+    }
+}
+
+/**
+ * Check whether this course exists in the tree
+ * \param courseNumber the course id number to validate
+ */
+bool BinarySearchTree::Exists(CourseKey courseNumber) const {
+    // use the search function, a NULL result means nothing was found
+    return this->Search(courseNumber) != nullptr;
+}
+
+/**
+ * Builds a perfectly balanced subtree from the sorted courses in the half-open
+ * range [lo, hi). The middle course becomes the root, and each half becomes one
+ * of its children. Heights are filled in on the way back up, so that the result
+ * is also a valid AVL tree.
+ *
+ * \param courses the sorted courses, which are moved out of the vector
+ * \param lo the first index of the range
+ * \param hi one past the last index of the range
+ * \return the root of the subtree, or NULL for an empty range
+ */
+Node *BinarySearchTree::buildRange(vector<Course> &courses, size_t lo, size_t hi) {
+    Node  *node;
+    size_t mid;
+    int    l, r;
+
+    if (lo >= hi)
+        return nullptr;
+
+    mid = lo + (hi - lo) / 2;
+    node = newNode(std::move(courses[mid]));
+    node->left = buildRange(courses, lo, mid);
+    node->right = buildRange(courses, mid + 1, hi);
+
+    l = node->left == nullptr ? 0 : node->left->height;
+    r = node->right == nullptr ? 0 : node->right->height;
+    node->height = (l > r ? l : r) + 1;
+    return node;
+}
+
+/**
+ * Replaces the contents of the tree with a batch of courses in a single O(n)
+ * pass. The courses are sorted first unless they already are, which for the
+ * registrar's exports costs nothing more than one look at each course.
+ *
+ * \param courses the courses to load, which must have been parsed into this
+ * tree's arena. They are moved into the tree, so the vector should be
+ * considered empty afterwards.
+ */
+void BinarySearchTree::Build(vector<Course> &courses) {
+    auto byNumber = [](const Course &a, const Course &b) {
+        return a.number < b.number;
+    };
+
+    // Only the old nodes are discarded here, the arena has to be kept as it
+    // holds the data for `courses`
+    root = nullptr;
+    freeList = nullptr;
+    // stable_sort keeps duplicate numbers in file order, the same order that
+    // `Insert` would have left them in
+    if (!is_sorted(courses.begin(), courses.end(), byNumber))
+        stable_sort(courses.begin(), courses.end(), byNumber);
+    root = buildRange(courses, 0, courses.size());
+}
+
+/**
+ * A self-balancing (AVL) Binary Search Tree. Searching and traversal are
+ * identical to the plain BST, so those are inherited. Insertion walks down the
+ * tree in the same way, but on the way back up each node's height is updated
+ * and any node whose subtrees differ in height by more than one is rotated back
+ * into balance. This keeps the height of the tree at O(log n) even when the
+ * courses are inserted in sorted order. Removal is inherited too, with every
+ * node on the way back up being rebalanced in the same way.
+ */
+class AvlTree : public BinarySearchTree {
+    private:
+        static int   height(Node *node);
+        static void  update(Node *node);
+        static Node *rotateLeft(Node *node);
+        static Node *rotateRight(Node *node);
+        static Node *rebalance(Node *node);
+        Node        *insertNode(Node *node, Course &course);
+        Node        *fixup(Node *node) override;
+
+    public:
+        void        Insert(Course &&course) override;
+        const char *getName() const override { return "avl"; }
+};
+
+/**
+ * Null-safe getter for the height of a subtree
+ * \param node the root of the subtree
+ * \return the height of the subtree, or 0 for an empty one
+ */
+int AvlTree::height(Node *node) {
+    return node == nullptr ? 0 : node->height;
+}
+
+/**
+ * Recalculates the height of `node` from the heights of its children
+ * \param node the node to update
+ */
+void AvlTree::update(Node *node) {
+    int l = height(node->left);
+    int r = height(node->right);
+    node->height = (l > r ? l : r) + 1;
+}
+
+/**
+ * Rotates the subtree rooted at `node` to the left, so that its right child
+ * becomes the new root of the subtree
+ * \param node the root of the subtree
+ * \return the new root of the subtree
+ */
+Node *AvlTree::rotateLeft(Node *node) {
+    Node *pivot = node->right;
+
+    node->right = pivot->left;
+    pivot->left = node;
+    // `node` is now below `pivot`, so it has to be updated first
+    update(node);
+    update(pivot);
+    return pivot;
+}
+
+/**
+ * Rotates the subtree rooted at `node` to the right, so that its left child
+ * becomes the new root of the subtree
+ * \param node the root of the subtree
+ * \return the new root of the subtree
+ */
+Node *AvlTree::rotateRight(Node *node) {
+    Node *pivot = node->left;
+
+    node->left = pivot->right;
+    pivot->right = node;
+    update(node);
+    update(pivot);
+    return pivot;
+}
+
+/**
+ * Restores the AVL property at `node`, assuming that both of its subtrees are
+ * already balanced
+ * \param node the root of the subtree
+ * \return the new root of the subtree
+ */
+Node *AvlTree::rebalance(Node *node) {
+    int balance;
+
+    update(node);
+    balance = height(node->left) - height(node->right);
+
+    if (balance > 1) {
+        // Left heavy. If the left child leans right this is the left-right case,
+        // which needs an extra rotation to become the left-left case
+        if (height(node->left->left) < height(node->left->right))
+            node->left = rotateLeft(node->left);
+        return rotateRight(node);
+    } else if (balance < -1) {
+        // Right heavy, mirror image of the above
+        if (height(node->right->right) < height(node->right->left))
+            node->right = rotateRight(node->right);
+        return rotateLeft(node);
+    }
+    return node;
+}
+
+/**
+ * Recursively inserts `course` into the subtree rooted at `node`, rebalancing
+ * each subtree on the way back up. Recursion depth is bounded by the height of
+ * the tree, which is O(log n).
+ *
+ * \param node the root of the subtree
+ * \param course the course to be inserted
+ * \return the new root of the subtree
+ */
+Node *AvlTree::insertNode(Node *node, Course &course) {
+    if (node == nullptr)
+        return newNode(std::move(course));
+
+    // Same ordering as the plain BST, matching numbers go to the right
+    if (course.number < node->course.number)
+        node->left = insertNode(node->left, course);
+    else
+        node->right = insertNode(node->right, course);
+
+    return rebalance(node);
+}
+
+/**
+ * Rebalances each node on the way back up from a removal
+ * \param node a node on the path back up from a removal
+ * \return the new root of the subtree
+ */
+Node *AvlTree::fixup(Node *node) {
+    return rebalance(node);
+}
+
+/**
+ * Insert a course into the tree, keeping it balanced
+ * \param course the course to be inserted, which is moved into the tree
+ */
+void AvlTree::Insert(Course &&course) {
+    this->root = insertNode(this->root, course);
+}
+
+/**
+ * A read-only index for catalogs which are loaded once and then searched
+ * over and over. The course numbers are kept in one contiguous array in
+ * Eytzinger order, which is a complete binary tree laid out breadth first: the
+ * root is at 1 and the children of k are at 2k and 2k + 1. A search is then a
+ * loop with no pointers to chase and no branch to mispredict, and since the
+ * descendants of k four levels down sit next to each other at 16k, they can be
+ * prefetched well before the search gets to them. The courses themselves are
+ * held in a separate array in sorted order, so the keys are packed eight to a
+ * cache line, and listing or ranging over the courses is a walk along an array.
+ *
+ * The layout has to be built all at once, so the index can only be filled by
+ * `Build`, and `Insert`, `Remove` and `Update` throw. The catalog loads it in
+ * bulk whatever the load mode, and reloads always build a new catalog on the
+ * side rather than changing it in place.
+ */
+class EytzingerIndex : public CourseIndex {
+    private:
+        vector<CourseKey> keys;    // Every course number in Eytzinger order, from 1
+        vector<u_int32_t> ranks;   // The position in `courses` of each of `keys`
+        vector<Course>    courses; // Every course, sorted by number
+
+        size_t fill(size_t k, size_t next); // Lays out the subtree rooted at k
+        size_t lowerBound(CourseKey courseNumber) const; // Finds the first course >= a number
+        size_t rankOf(size_t k) const;      // Finds where a finished search ended up
+
+    public:
+        void          drain() override;
+        void          ForEach(const Visitor &visit) const override;
+        void          Range(CourseKey lo, CourseKey hi, const Visitor &visit) const override;
+        void          Insert(Course &&course) override;
+        bool          Remove(CourseKey courseNumber) override;
+        bool          Update(Course &&course) override;
+        const Course *Search(CourseKey courseNumber) const override;
+        void          SearchMany(const CourseKey *courseNumbers, size_t count,
+                              const Course **results) const override;
+        bool          Exists(CourseKey courseNumber) const override;
+        void          Build(vector<Course> &courses) override;
+        IndexStats    getStats() const override;
+        const char   *getName() const override { return "eytzinger"; }
+        bool          isReadOnly() const override { return true; }
+};
+
+/**
+ * Empties the index, releasing the arena which holds every course's data
+ */
+void EytzingerIndex::drain() {
+    keys.clear();
+    ranks.clear();
+    courses.clear();
+    arena.reset();
+}
+
+/**
+ * Visits every course, in alphanumeric order
+ * \param visit the function to call for each course
+ */
+void EytzingerIndex::ForEach(const Visitor &visit) const {
+    for (const Course &course : courses)
+        visit(course);
+}
+
+/**
+ * Visits every course numbered from `lo` to `hi` inclusive, in alphanumeric
+ * order. Only the first one is searched for, the rest follow it in the array.
+ * \param lo the first course number to include
+ * \param hi the last course number to include
+ * \param visit the function to call for each matching course
+ */
+void EytzingerIndex::Range(CourseKey lo, CourseKey hi, const Visitor &visit) const {
+    size_t i;
+
+    for (i = lowerBound(lo); i < courses.size() && courses[i].number <= hi; i++)
+        visit(courses[i]);
+}
+
+/**
+ * Always throws, the layout cannot be changed one course at a time
+ * \throws logic_error always
+ */
+void EytzingerIndex::Insert(Course &&) {
+    throw logic_error("The eytzinger index can only be built in bulk");
+}
+
+/**
+ * Always throws, the layout cannot be changed one course at a time
+ * \throws logic_error always
+ */
+bool EytzingerIndex::Remove(CourseKey) {
+    throw logic_error("The eytzinger index can only be built in bulk");
+}
+
+/**
+ * Always throws, the layout cannot be changed one course at a time
+ * \throws logic_error always
+ */
+bool EytzingerIndex::Update(Course &&) {
+    throw logic_error("The eytzinger index can only be built in bulk");
+}
+
+/**
+ * Finds where a search which has run off the bottom of the tree at k ended
+ * up. The position is recovered from the bits of k: every 1 on the end is a
+ * step right which came after the answer, and the 0 before them is where it
+ * stepped left onto it.
+ * \param k where the search ran off the tree
+ * \return the position in `courses` of the first course numbered at or after
+ * the one searched for, or the number of courses if there is none
+ */
+size_t EytzingerIndex::rankOf(size_t k) const {
+    while (k & 1)
+        k >>= 1;
+    k >>= 1;
+    return k == 0 ? courses.size() : ranks[k];
+}
+
+/**
+ * Finds the position in `courses` of the first course numbered `courseNumber`
+ * or later. Each step goes left or right by adding the result of the compare.
+ * \param courseNumber the course number to look for
+ * \return the position of the course, or the number of courses if every
+ * course is numbered before `courseNumber`
+ */
+size_t EytzingerIndex::lowerBound(CourseKey courseNumber) const {
+    const CourseKey *base = keys.data();
+    size_t           n = courses.size();
+    size_t           k = 1;
+
+    while (k <= n) {
+        // The 16 descendants four levels down, which are two cache lines. Near
+        // the bottom there are none, and the address would be off the array.
+        if (16 * k <= n)
+            PREFETCH(base + 16 * k);
+        k = 2 * k + (base[k] < courseNumber);
+    }
+    return rankOf(k);
+}
+
+/**
+ * Searches for a batch of courses, `SEARCH_GROUP` at a time. The searches in a
+ * group step down the tree level by level together, so the prefetches of all
+ * of them are in flight at once.
+ * \param courseNumbers the course numbers to look for
+ * \param count the number of course numbers
+ * \param results filled in with the matching course for each number, or NULL
+ */
+void EytzingerIndex::SearchMany(const CourseKey *courseNumbers, size_t count,
+        const Course **results) const {
+    const CourseKey *base = keys.data();
+    size_t           n = courses.size();
+    size_t           k[SEARCH_GROUP];
+    size_t           start;
+    size_t           group;
+    size_t           i;
+    bool             more;
+
+    for (start = 0; start < count; start += group) {
+        group = count - start < SEARCH_GROUP ? count - start : SEARCH_GROUP;
+        for (i = 0; i < group; i++)
+            k[i] = 1;
+        // The searches only differ in depth by one, on the last level
+        do {
+            more = false;
+            for (i = 0; i < group; i++) {
+                if (k[i] > n)
+                    continue;
+                if (16 * k[i] <= n)
+                    PREFETCH(base + 16 * k[i]);
+                k[i] = 2 * k[i] + (base[k[i]] < courseNumbers[start + i]);
+                more = true;
+            }
+        } while (more);
+        for (i = 0; i < group; i++) {
+            size_t rank = rankOf(k[i]);
+
+            results[start + i] = rank == n || courses[rank].number != courseNumbers[start + i]
+                ? nullptr : &courses[rank];
+        }
+    }
+}
+
+/**
+ * Searches for a course. Where a number was duplicated this finds the first
+ * of them in file order.
+ * \param courseNumber the course number to look for
+ * \return the matching course, or NULL if there is none
+ */
+const Course *EytzingerIndex::Search(CourseKey courseNumber) const {
+    size_t i = lowerBound(courseNumber);
+
+    if (i == courses.size() || courses[i].number != courseNumber)
+        return nullptr;
+    return &courses[i];
+}
+
+/**
+ * Check whether this course exists in the index
+ * \param courseNumber the course id number to validate
+ */
+bool EytzingerIndex::Exists(CourseKey courseNumber) const {
+    return this->Search(courseNumber) != nullptr;
+}
+
+/**
+ * Lays out the subtree rooted at k, whose nodes take the next courses in
+ * sorted order. The recursion is only as deep as the tree, which is O(log n).
+ * \param k the root of the subtree
+ * \param next the position of the next course in sorted order
+ * \return the position after the last course in the subtree
+ */
+size_t EytzingerIndex::fill(size_t k, size_t next) {
+    if (k > courses.size())
+        return next;
+    next = fill(2 * k, next);
+    keys[k] = courses[next].number;
+    ranks[k] = (u_int32_t)next;
+    return fill(2 * k + 1, next + 1);
+}
+
+/**
+ * Replaces the contents of the index with a batch of courses, sorting them
+ * unless they already are and then laying out the keys, which is O(n) beyond
+ * the sort.
+ * \param courses the courses to load, which must have been parsed into this
+ * index's arena. They are moved into the index, so the vector is left empty.
+ */
+void EytzingerIndex::Build(vector<Course> &courses) {
+    auto byNumber = [](const Course &a, const Course &b) {
+        return a.number < b.number;
+    };
+
+    // stable_sort keeps duplicate numbers in file order
+    if (!is_sorted(courses.begin(), courses.end(), byNumber))
+        stable_sort(courses.begin(), courses.end(), byNumber);
+    this->courses = std::move(courses);
+    courses.clear();
+    // Nothing is ever added to `courses` again, so the courses never move
+    this->courses.shrink_to_fit();
+    keys.assign(this->courses.size() + 1, CourseKey());
+    ranks.assign(this->courses.size() + 1, 0);
+    fill(1, 0);
+}
+
+/**
+ * Measures the shape of the index. The tree is complete, so every level is
+ * full except perhaps the last.
+ * \return the number of courses, the height and the average depth of a course
+ */
+IndexStats EytzingerIndex::getStats() const {
+    IndexStats stats;
+    size_t     level;
+    size_t     total = 0;
+
+    stats.nodes = courses.size();
+    for (level = 1; level <= stats.nodes; level *= 2) {
+        stats.height++;
+        total += stats.height * (min(2 * level - 1, stats.nodes) - level + 1);
+    }
+    stats.averageDepth = stats.nodes == 0 ? 0 : (double)total / stats.nodes;
+    return stats;
+}
+
+/**
+ * Creates a new, empty index of the requested type
+ * \param engine the type of index to create
+ * \return the new index, which the caller is responsible for deleting
+ */
+CourseIndex *CourseIndex::create(IndexEngine engine) {
+    switch (engine) {
+        case IndexBST:
+            return new BinarySearchTree();
+        case IndexAVL:
+            return new AvlTree();
+        case IndexEytzinger:
+            return new EytzingerIndex();
+    }
+    throw invalid_argument("Unknown index engine");
+}
+
+/**
+ * An index split into shards, one for each department, so that a catalog
+ * brought together from several departments' or campuses' csv files is held
+ * as many small indexes rather than one large one. A department is the part of
+ * a course number before its first digit, such as CSCI for CSCI300, and each
+ * shard is an index of whichever engine was asked for. Every operation on a
+ * course is routed to its department's shard by a binary search of the
+ * departments, so a prerequisite is resolved against whichever shard holds it.
+ * A bulk build splits the courses up by department and builds the shards in
+ * parallel.
+ *
+ * Two departments' course numbers never sort in among each other: either the
+ * departments differ before one of them ends, or one is the start of the other
+ * and its numbers all have a digit where the other's all have the same
+ * non-digit, and the digits sort together on the same side of any other
+ * character. So visiting the shards in the order of their first courses
+ * visits every course in order.
+ */
+class ShardedIndex : public CourseIndex {
+    private:
+        /**
+         * The index holding one department's courses
+         */
+        struct Shard {
+            CourseKey               department; // The department, padded with zeros
+            CourseKey               first;      // One of its course numbers, which
+                                                // orders the shard among the others
+            unique_ptr<CourseIndex> index;      // The department's courses
+        };
+
+        IndexEngine   engine;   // The engine every shard uses
+        unsigned      threads;  // Threads to build the shards on, 0 for one per core
+        string        name;     // The engine's name, marked as sharded
+        bool          readOnly; // Whether the engine can only be filled by `Build`
+        vector<Shard> shards;   // Every shard, in course number order
+        string        mapPath;  // Where to map the shards' arenas from, empty for the heap
+        vector<pair<CourseKey, u_int32_t>> departments; // Every department, sorted,
+                                // and the position of its shard in `shards`
+
+        static const u_int32_t NO_SHARD = UINT32_MAX; // `locate`s answer for an unknown department
+
+        static CourseKey departmentOf(CourseKey courseNumber); // Finds a course's department
+        u_int32_t    locate(CourseKey courseNumber) const; // Finds the position of a course's shard
+        CourseIndex *route(CourseKey courseNumber) const; // Finds a course's shard
+        CourseIndex *addShard(CourseKey courseNumber); // Adds a shard for a new department
+        void         indexDepartments(); // Sorts the shards and rebuilds `departments`
+
+    public:
+        ShardedIndex(IndexEngine engine, unsigned threads); // Constructor, with the engine
+                                // for the shards and the threads to build them on
+        void          drain() override;
+        size_t        getMemoryUsed() override;
+        void          mapArena(const string &path) override;
+        void          ForEach(const Visitor &visit) const override;
+        void          Range(CourseKey lo, CourseKey hi, const Visitor &visit) const override;
+        void          Insert(Course &&course) override;
+        bool          Remove(CourseKey courseNumber) override;
+        bool          Update(Course &&course) override;
+        const Course *Search(CourseKey courseNumber) const override;
+        void          SearchMany(const CourseKey *courseNumbers, size_t count,
+                              const Course **results) const override;
+        bool          Exists(CourseKey courseNumber) const override;
+        void          Build(vector<Course> &courses) override;
+        IndexStats    getStats() const override;
+        const char   *getName() const override { return name.c_str(); }
+        bool          isReadOnly() const override { return readOnly; }
+};
+
+/**
+ * Constructor
+ * \param engine the type of index to use for every shard
+ * \param threads the number of threads a bulk build may use, 0 for one per core
+ */
+ShardedIndex::ShardedIndex(IndexEngine engine, unsigned threads)
+    : engine(engine), threads(threads) {
+    unique_ptr<CourseIndex> probe(CourseIndex::create(engine));
+
+    name = string("sharded-") + probe->getName();
+    readOnly = probe->isReadOnly();
+}
+
+/**
+ * Finds the department of a course number, which is everything before its
+ * first digit
+ * \param courseNumber the course number
+ * \return the department, as a key padded with zeros
+ */
+CourseKey ShardedIndex::departmentOf(CourseKey courseNumber) {
+    CourseKey department = courseNumber;
+    size_t    i;
+
+    // Every lookup is routed through here, so the characters are read straight
+    // out of the packed words rather than unpacked into a string first
+    for (i = 0; i < CourseKey::WIDTH; i++) {
+        unsigned char c = (unsigned char)(department.words[i / 8] >> CourseKey::shift(i));
+        if (c >= '0' && c <= '9')
+            break;
+    }
+    for (; i < CourseKey::WIDTH; i++)
+        department.words[i / 8] &= ~((u_int64_t)0xff << CourseKey::shift(i));
+    return department;
+}
+
+/**
+ * Finds the position in `shards` of the shard which holds, or would hold, a
+ * course
+ * \param courseNumber the course number
+ * \return the position of its department's shard, or `NO_SHARD` if there is none
+ */
+u_int32_t ShardedIndex::locate(CourseKey courseNumber) const {
+    CourseKey department = departmentOf(courseNumber);
+    auto      it = lower_bound(departments.begin(), departments.end(), department,
+            [](const pair<CourseKey, u_int32_t> &d, CourseKey key) { return d.first < key; });
+
+    if (it == departments.end() || it->first != department)
+        return NO_SHARD;
+    return it->second;
+}
+
+/**
+ * Finds the shard which holds, or would hold, a course
+ * \param courseNumber the course number
+ * \return its department's shard, or NULL if there is none
+ */
+CourseIndex *ShardedIndex::route(CourseKey courseNumber) const {
+    u_int32_t shard = locate(courseNumber);
+
+    return shard == NO_SHARD ? nullptr : shards[shard].index.get();
+}
+
+/**
+ * Sorts the shards into course number order, and rebuilds the list of
+ * departments to match
+ */
+void ShardedIndex::indexDepartments() {
+    u_int32_t i;
+
+    sort(shards.begin(), shards.end(), [](const Shard &a, const Shard &b) {
+        return a.first < b.first;
+    });
+    departments.clear();
+    for (i = 0; i < shards.size(); i++)
+        departments.emplace_back(shards[i].department, i);
+    sort(departments.begin(), departments.end(),
+            [](const pair<CourseKey, u_int32_t> &a, const pair<CourseKey, u_int32_t> &b) {
+        return a.first < b.first;
+    });
+}
+
+/**
+ * Adds an empty shard for the department of a course which has none yet
+ * \param courseNumber the course number
+ * \return the new shard
+ */
+CourseIndex *ShardedIndex::addShard(CourseKey courseNumber) {
+    CourseIndex *index = CourseIndex::create(engine);
+
+    if (!mapPath.empty())
+        index->mapArena(mapPath + "." + to_string(shards.size()));
+    shards.push_back({ departmentOf(courseNumber), courseNumber, unique_ptr<CourseIndex>(index) });
+    indexDepartments();
+    return index;
+}
+
+/**
+ * Empties the index, releasing every shard and the arena which holds every
+ * course's data
+ */
+void ShardedIndex::drain() {
+    shards.clear();
+    departments.clear();
+    arena.reset();
+}
+
+/**
+ * Getter
+ * \return the number of bytes held by the course data and by every shard
+ */
+size_t ShardedIndex::getMemoryUsed() {
+    size_t used = arena.getSize();
+
+    for (Shard &shard : shards)
+        used += shard.index->getMemoryUsed();
+    return used;
+}
+
+/**
+ * Maps the course data, and every shard created from now on, from scratch
+ * files, each shard's named after `path` and its position
+ * \param path where to create the scratch file for the course data
+ */
+void ShardedIndex::mapArena(const string &path) {
+    arena.mapTo(path);
+    mapPath = path;
+}
+
+/**
+ * Visits every course, in alphanumeric order
+ * \param visit the function to call for each course
+ */
+void ShardedIndex::ForEach(const Visitor &visit) const {
+    for (const Shard &shard : shards)
+        shard.index->ForEach(visit);
+}
+
+/**
+ * Visits the courses numbered from `lo` to `hi` inclusive, in order. Each
+ * shard seeks straight to the range, so the shards outside it cost a single
+ * search apiece.
+ * \param lo the first course number in the range
+ * \param hi the last course number in the range
+ * \param visit the function to call for each course
+ */
+void ShardedIndex::Range(CourseKey lo, CourseKey hi, const Visitor &visit) const {
+    for (const Shard &shard : shards)
+        shard.index->Range(lo, hi, visit);
+}
+
+/**
+ * Inserts a course into its department's shard, adding the shard if this is
+ * the department's first course
+ * \param course the course to be inserted, which is moved into the index
+ */
+void ShardedIndex::Insert(Course &&course) {
+    CourseIndex *shard = route(course.number);
+
+    if (shard == nullptr)
+        shard = addShard(course.number);
+    shard->Insert(std::move(course));
+}
+
+/**
+ * Removes a course from its department's shard. The shard is kept even once it
+ * is empty, as it still orders the department among the others.
+ * \param courseNumber the number of the course to remove
+ * \return true if the course was found and removed
+ */
+bool ShardedIndex::Remove(CourseKey courseNumber) {
+    CourseIndex *shard = route(courseNumber);
+
+    return shard != nullptr && shard->Remove(courseNumber);
+}
+
+/**
+ * Replaces the details of a course in its department's shard
+ * \param course the new details, which are moved into the index
+ * \return true if the course was found and updated
+ */
+bool ShardedIndex::Update(Course &&course) {
+    CourseIndex *shard = route(course.number);
+
+    return shard != nullptr && shard->Update(std::move(course));
+}
+
+/**
+ * Searches for a course in its department's shard
+ * \param courseNumber the course number to search for
+ * \return the course, or NULL if there is none
+ */
+const Course *ShardedIndex::Search(CourseKey courseNumber) const {
+    const CourseIndex *shard = route(courseNumber);
+
+    return shard == nullptr ? nullptr : shard->Search(courseNumber);
+}
+
+/**
+ * Searches for a batch of courses at once. The course numbers are taken a
+ * group at a time and sorted by shard, and each shard's share of the group is
+ * handed to its `SearchMany` in one go, so the shard's own interleaving still
+ * applies however the numbers were ordered. Validation, for one, looks its
+ * prerequisites up in hash table order.
+ * \param courseNumbers the course numbers to look for
+ * \param count the number of course numbers
+ * \param results filled in with the matching course for each number, or NULL
+ */
+void ShardedIndex::SearchMany(const CourseKey *courseNumbers, size_t count,
+        const Course **results) const {
+    const size_t              GROUP = 256; // course numbers sorted by shard at once
+    pair<u_int32_t, u_int32_t> order[GROUP]; // the shard of each number, and its position
+    CourseKey                 keys[GROUP];  // the numbers in shard order
+    const Course             *found[GROUP];
+    size_t                    base;
+    size_t                    n;
+    size_t                    i;
+    size_t                    j;
+
+    for (base = 0; base < count; base += n) {
+        n = min(GROUP, count - base);
+        for (i = 0; i < n; i++)
+            order[i] = { locate(courseNumbers[base + i]), (u_int32_t)i };
+        sort(order, order + n);
+        for (i = 0; i < n; i++)
+            keys[i] = courseNumbers[base + order[i].second];
+        for (i = 0; i < n; i = j) {
+            for (j = i + 1; j < n && order[j].first == order[i].first; j++)
+                ;
+            if (order[i].first == NO_SHARD)
+                fill(found + i, found + j, nullptr);
+            else
+                shards[order[i].first].index->SearchMany(keys + i, j - i, found + i);
+        }
+        for (i = 0; i < n; i++)
+            results[base + order[i].second] = found[i];
+    }
+}
+
+/**
+ * Checks whether a course is in its department's shard
+ * \param courseNumber the course number to search for
+ * \return true if the course exists
+ */
+bool ShardedIndex::Exists(CourseKey courseNumber) const {
+    const CourseIndex *shard = route(courseNumber);
+
+    return shard != nullptr && shard->Exists(courseNumber);
+}
+
+/**
+ * Builds the index from a list of courses, splitting them up by department and
+ * then building every shard at once, on as many threads as `--threads` allows
+ * when there are enough courses to be worth it. The courses keep their order
+ * within each department, so duplicates are resolved just as they would be by
+ * a single index.
+ * \param courses the courses, which are moved into the shards
+ */
+void ShardedIndex::Build(vector<Course> &courses) {
+    const size_t           MIN_PARALLEL = 64 * 1024; // fewest courses worth the threads
+    vector<pair<CourseKey, u_int32_t>> found; // Each department so far, and its batch
+    vector<vector<Course>> batches;
+    vector<exception_ptr>  errors;
+    vector<thread>         workers;
+    atomic<size_t>         claimed(0);
+    CourseKey              department;
+    u_int32_t              current = 0;
+    size_t                 n;
+    size_t                 t;
+
+    // Only the old shards are discarded here, the arena has to be kept as it
+    // holds the data for `courses`
+    shards.clear();
+    departments.clear();
+    for (Course &course : courses) {
+        CourseKey key = departmentOf(course.number);
+
+        // Courses from the same department usually come one after another
+        if (batches.empty() || key != department) {
+            auto it = lower_bound(found.begin(), found.end(), key,
+                    [](const pair<CourseKey, u_int32_t> &d, CourseKey k) { return d.first < k; });
+            if (it == found.end() || it->first != key) {
+                it = found.insert(it, { key, (u_int32_t)batches.size() });
+                batches.emplace_back();
+            }
+            department = key;
+            current = it->second;
+        }
+        batches[current].push_back(std::move(course));
+    }
+    courses.clear();
+
+    // Any course orders its department among the others
+    for (vector<Course> &batch : batches) {
+        shards.push_back({ departmentOf(batch[0].number), batch[0].number,
+                unique_ptr<CourseIndex>(CourseIndex::create(engine)) });
+        if (!mapPath.empty())
+            shards.back().index->mapArena(mapPath + "." + to_string(shards.size() - 1));
+    }
+
+    n = 0;
+    for (vector<Course> &batch : batches)
+        n += batch.size();
+    t = threads == 0 ? thread::hardware_concurrency() : threads;
+    n = n < MIN_PARALLEL ? 1 : min<size_t>(max<size_t>(t, 1), shards.size());
+    errors.resize(n);
+    auto build = [&](size_t t) {
+        size_t i;
+
+        try {
+            while ((i = claimed.fetch_add(1)) < shards.size())
+                shards[i].index->Build(batches[i]);
+        } catch (...) {
+            errors[t] = current_exception();
+        }
+    };
+    for (t = 1; t < n; t++)
+        workers.emplace_back(build, t);
+    build(0);
+    for (thread &worker : workers)
+        worker.join();
+    for (exception_ptr &error : errors) {
+        if (error)
+            rethrow_exception(error);
+    }
+    indexDepartments();
+}
+
+/**
+ * Measures the shape of the index, as the shards all together. Finding the
+ * shard is a binary search of the departments rather than a walk down the
+ * index, so it is not counted in the depths.
+ * \return the number of courses, the height of the tallest shard and the mean
+ * depth of a course in its shard
+ */
+IndexStats ShardedIndex::getStats() const {
+    IndexStats stats;
+    double     total = 0;
+
+    for (const Shard &shard : shards) {
+        IndexStats part = shard.index->getStats();
+
+        stats.nodes += part.nodes;
+        stats.height = max(stats.height, part.height);
+        total += part.averageDepth * part.nodes;
+    }
+    stats.averageDepth = stats.nodes == 0 ? 0 : total / stats.nodes;
+    return stats;
+}
+
+/**
+ * Builds the path of a scratch file in the system's temporary directory
+ * \param name the name of the file
+ * \return the path
+ */
+static string temporaryPath(const string &name) {
+    const char *dir = getenv("TMPDIR");
+
+    return string(dir == nullptr || *dir == '\0' ? "/tmp" : dir) + "/" + name;
+}
+
+/**
+ * Saves and restores a validated catalog as a compact binary snapshot. The
+ * layout is a fixed header, then one fixed size record per course in index
+ * order, then every prerequisite key, then every title, with all offsets
+ * relative to the start of the file. Prerequisites are stored already resolved:
+ * alongside each prerequisite key is the record number of the course it names,
+ * so the links can be restored without searching. Being fixed width and already sorted, a
+ * snapshot can be mapped into memory and used without any parsing, and the
+ * index can be built from it with a single bulk `Build`.
+ *
+ * A catalog too large to hold in memory can also be written out in pieces, as
+ * sorted runs which `merge` combines into a snapshot, resolving the links
+ * against the merged records on disk rather than against an index.
+ *
+ * The snapshot records the size and modification time of the csv file it was
+ * built from. If either no longer matches then the snapshot is stale and is
+ * ignored. The format is in native byte order, and a snapshot from a machine
+ * with a different byte order (or from a different version of the program) is
+ * likewise ignored.
+ */
+class Snapshot {
+    private:
+        static const u_int32_t VERSION = 2;
+        static const u_int32_t BYTE_ORDER_MARK = 0x01020304;
+
+        /**
+         * The header at the start of every snapshot
+         */
+        struct Header {
+            char      magic[8];    //! Always "ABCUSNAP"
+            u_int32_t version;     //! `VERSION` of the program which wrote it
+            u_int32_t byteOrder;   //! `BYTE_ORDER_MARK`, as written by that machine
+            u_int32_t keyWidth;    //! `CourseKey::WIDTH`
+            u_int32_t reserved;
+            u_int64_t sourceSize;  //! The size of the csv file
+            int64_t   sourceMtime; //! The modification time of the csv file, in ns
+            u_int64_t courseCount; //! The number of course records
+            u_int64_t prereqCount; //! The total number of prerequisite keys and links
+            u_int64_t titleBytes;  //! The total length of all of the titles
+        };
+
+        /**
+         * The record for a single course
+         */
+        struct Record {
+            CourseKey number;       //! The course number
+            u_int64_t titleOffset;  //! Where the title starts
+            u_int64_t prereqOffset; //! Where the prerequisite keys start. The record
+                                //! numbers of the linked courses start at the
+                                //! same position in the link array
+            u_int32_t titleLength;  //! The length of the title
+            u_int32_t prereqCount;  //! The number of prerequisite keys
+        };
+
+        /**
+         * The start of each course in a run, which is followed by the course's
+         * prerequisite keys and then its title, with no padding
+         */
+        struct RunRecord {
+            CourseKey number;      //! The course number
+            u_int32_t titleLength; //! The length of the title
+            u_int32_t prereqCount; //! The number of prerequisite keys
+        };
+
+        static void fillHeader(Header &header, const struct stat &source);
+
+    public:
+        /**
+         * Where a sorted run starts in a run file, and its totals
+         */
+        struct Run {
+            u_int64_t offset = 0;      //! The position of its first course
+            u_int64_t courseCount = 0; //! The number of courses in it
+            u_int64_t prereqCount = 0; //! The total number of prerequisite keys
+            u_int64_t titleBytes = 0;  //! The total length of the titles
+        };
+
+        static void   statSource(const vector<string> &csvPaths, struct stat &source);
+        static int64_t modificationTime(const struct stat &source);
+        static void   save(const string &path, const CourseIndex *index, const struct stat &source);
+        static size_t load(const string &path, CourseIndex *index, const struct stat &source);
+        static Run    saveRun(ostream &out, const CourseIndex *index); // Appends a sorted run
+        static bool   merge(const string &runsPath, const vector<Run> &runs, const string &path,
+                const struct stat &source); // Merges sorted runs into a snapshot
+};
+
+/**
+ * Gets the size and modification time of the csv files, which are used to tell
+ * whether a snapshot is stale. For several files these are the details of the
+ * one modified most recently, with the size being the total across them all.
+ * \param csvPaths the paths to the csv files
+ * \param source filled in with the files' details
+ * \throws runtime_error if a csv file does not exist
+ */
+void Snapshot::statSource(const vector<string> &csvPaths, struct stat &source) {
+    struct stat file;
+    off_t       total = 0;
+    size_t      i;
+
+    for (i = 0; i < csvPaths.size(); i++) {
+        if (stat(csvPaths[i].c_str(), &file) != 0)
+            throw runtime_error("Unable to open " + csvPaths[i]);
+        if (i == 0 || modificationTime(file) > modificationTime(source))
+            source = file;
+        total += file.st_size;
+    }
+    source.st_size = total;
+}
+
+/**
+ * Maps every csv file into memory
+ * \param csvPaths the paths to the csv files
+ * \param files filled in with the mapped files, which have to stay open for as
+ * long as `views` is used
+ * \param views filled in with the contents of each file
+ * \throws runtime_error if a csv file cannot be opened
+ */
+static void mapSources(const vector<string> &csvPaths, vector<unique_ptr<MappedFile>> &files,
+        vector<string_view> &views) {
+    for (const string &path : csvPaths) {
+        files.push_back(make_unique<MappedFile>());
+        if (!files.back()->open(path))
+            throw runtime_error("Unable to open " + path);
+        views.push_back(files.back()->view());
+    }
+}
+
+/**
+ * Gets the modification time of a file in nanoseconds, at whatever resolution
+ * the platform records it
+ * \param source the details of the file
+ * \return the modification time
+ */
+int64_t Snapshot::modificationTime(const struct stat &source) {
+#if defined(__APPLE__)
+    return source.st_mtimespec.tv_sec * 1000000000LL + source.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    return source.st_mtime * 1000000000LL;
+#else
+    return source.st_mtim.tv_sec * 1000000000LL + source.st_mtim.tv_nsec;
+#endif
+}
+
+/**
+ * Fills in everything in a header which does not depend on the catalog itself
+ * \param header the header to fill in
+ * \param source the details of the csv file
+ */
+void Snapshot::fillHeader(Header &header, const struct stat &source) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "ABCUSNAP", sizeof(header.magic));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.keyWidth = CourseKey::WIDTH;
+    header.sourceSize = source.st_size;
+    header.sourceMtime = modificationTime(source);
+}
+
+/**
+ * Writes the contents of `index` to a snapshot. The snapshot is written to a
+ * temporary file which is then renamed over `path`, so that a reader never sees
+ * a partially written snapshot.
+ *
+ * \param path where to write the snapshot
+ * \param index the loaded and validated catalog
+ * \param source the details of the csv file the catalog was loaded from
+ * \throws runtime_error if the snapshot cannot be written
+ */
+void Snapshot::save(const string &path, const CourseIndex *index, const struct stat &source) {
+    vector<const Course *>                 courses;
+    unordered_map<const Course *, u_int32_t> recordNumbers;
+    Header                                 header;
+    Record                                 record;
+    string                                 tmpPath = path + ".tmp";
+    ofstream                               out;
+    u_int64_t                              prereqOffset;
+    u_int64_t                              titleOffset;
+
+    // Gather the courses in index order, and total up the variable length parts
+    fillHeader(header, source);
+    index->ForEach([&](const Course &course) {
+        recordNumbers[&course] = courses.size();
+        courses.push_back(&course);
+        header.prereqCount += course.prerequisites.size;
+        header.titleBytes += course.title.size();
+    });
+    header.courseCount = courses.size();
+
+    out.open(tmpPath, ios::binary | ios::trunc);
+    if (!out)
+        throw runtime_error("Unable to write snapshot " + tmpPath);
+    out.write((const char *)&header, sizeof(header));
+
+    // The prerequisite keys follow the records, then the links, and the titles
+    // follow those. Everything before the keys is a multiple of 8 bytes, so the
+    // keys can be used in place from a mapping.
+    prereqOffset = sizeof(Header) + courses.size() * sizeof(Record);
+    titleOffset = prereqOffset + header.prereqCount * (sizeof(CourseKey) + sizeof(u_int32_t));
+    for (const Course *course : courses) {
+        record.number = course->number;
+        record.titleOffset = titleOffset;
+        record.titleLength = course->title.size();
+        record.prereqOffset = prereqOffset;
+        record.prereqCount = course->prerequisites.size;
+        out.write((const char *)&record, sizeof(record));
+        titleOffset += record.titleLength;
+        prereqOffset += record.prereqCount * sizeof(CourseKey);
+    }
+    for (const Course *course : courses)
+        out.write((const char *)course->prerequisites.data,
+                course->prerequisites.size * sizeof(CourseKey));
+    for (const Course *course : courses) {
+        for (const Course *link : course->prerequisiteLinks) {
+            u_int32_t target = recordNumbers.at(link);
+            out.write((const char *)&target, sizeof(target));
+        }
+    }
+    for (const Course *course : courses)
+        out.write(course->title.data(), course->title.size());
+
+    out.close();
+    if (!out || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        throw runtime_error("Unable to write snapshot " + path);
+    }
+}
+
+/**
+ * Appends the contents of `index` to a run file as one sorted run, in index
+ * order. Prerequisites are written as keys only, as they are not resolved
+ * until the runs are merged.
+ *
+ * \param out the run file, which the caller checks for errors
+ * \param index the courses to write out
+ * \return where the run starts and its totals
+ */
+Snapshot::Run Snapshot::saveRun(ostream &out, const CourseIndex *index) {
+    Run       run;
+    RunRecord record;
+
+    run.offset = out.tellp();
+    index->ForEach([&](const Course &course) {
+        record.number = course.number;
+        record.titleLength = course.title.size();
+        record.prereqCount = course.prerequisites.size;
+        out.write((const char *)&record, sizeof(record));
+        out.write((const char *)course.prerequisites.data,
+                course.prerequisites.size * sizeof(CourseKey));
+        out.write(course.title.data(), course.title.size());
+        run.courseCount++;
+        run.prereqCount += record.prereqCount;
+        run.titleBytes += record.titleLength;
+    });
+    return run;
+}
+
+/**
+ * Merges sorted runs into a snapshot, without ever holding more than one course
+ * from each run. The runs are merged in course number order, with a course
+ * number found in several runs taken from the earliest run first, so the
+ * records come out in the same order as they would from a single index. The
+ * keys and titles go to scratch files beside the snapshot while the records are
+ * written, and are appended once the records are complete.
+ *
+ * Each prerequisite is then resolved by a binary search of the merged records,
+ * which are read from the file rather than from memory, taking the first of
+ * any duplicated course number. Every prerequisite which names a course that
+ * does not exist is reported, and no snapshot is left behind.
+ *
+ * \param runsPath the run file
+ * \param runs where each run starts in the run file, in the order they were saved
+ * \param path where to write the snapshot
+ * \param source the details of the csv files the runs were loaded from
+ * \return true if every prerequisite exists
+ * \throws runtime_error if a file cannot be read or written
+ */
+bool Snapshot::merge(const string &runsPath, const vector<Run> &runs, const string &path,
+        const struct stat &source) {
+    /**
+     * The next course in one of the runs
+     */
+    struct Cursor {
+        RunRecord   record; // The course's fixed size part
+        const char *next;   // Where its prerequisite keys start
+        const char *end;    // The end of the run
+        size_t      run;    // The position of the run, which breaks ties
+    };
+    auto later = [](const Cursor &a, const Cursor &b) {
+        return b.record.number < a.record.number
+            || (a.record.number == b.record.number && a.run > b.run);
+    };
+    priority_queue<Cursor, vector<Cursor>, decltype(later)> heap(later);
+    string          tmpPath = path + ".tmp";
+    string          keysPath = path + ".keys";
+    string          titlesPath = path + ".titles";
+    MappedFile      input;
+    MappedFile      merged;
+    MappedFile      keys;
+    MappedFile      titles;
+    string_view     data;
+    ofstream        out;
+    ofstream        keysOut;
+    ofstream        titlesOut;
+    Header          header;
+    Record          record;
+    Cursor          cursor;
+    const Record   *records;
+    const CourseKey *key;
+    u_int64_t       prereqOffset;
+    u_int64_t       titleOffset;
+    u_int64_t       missing = 0;
+    u_int64_t       i;
+    u_int32_t       j;
+    size_t          r;
+
+    auto cleanUp = [&]() {
+        remove(tmpPath.c_str());
+        remove(keysPath.c_str());
+        remove(titlesPath.c_str());
+    };
+    auto fail = [&](const string &what) {
+        cleanUp();
+        throw runtime_error("Unable to " + what);
+    };
+
+    fillHeader(header, source);
+    for (const Run &run : runs) {
+        header.courseCount += run.courseCount;
+        header.prereqCount += run.prereqCount;
+        header.titleBytes += run.titleBytes;
+    }
+    if (!input.open(runsPath))
+        fail("read " + runsPath);
+    data = input.view();
+    for (r = 0; r < runs.size(); r++) {
+        cursor.next = data.data() + runs[r].offset;
+        cursor.end = r + 1 < runs.size() ? data.data() + runs[r + 1].offset
+            : data.data() + data.size();
+        cursor.run = r;
+        if (cursor.next < cursor.end) {
+            memcpy(&cursor.record, cursor.next, sizeof(RunRecord));
+            cursor.next += sizeof(RunRecord);
+            heap.push(cursor);
+        }
+    }
+
+    // Lay the snapshot out exactly as `save` does
+    out.open(tmpPath, ios::binary | ios::trunc);
+    keysOut.open(keysPath, ios::binary | ios::trunc);
+    titlesOut.open(titlesPath, ios::binary | ios::trunc);
+    if (!out || !keysOut || !titlesOut)
+        fail("write snapshot " + path);
+    out.write((const char *)&header, sizeof(header));
+    prereqOffset = sizeof(Header) + header.courseCount * sizeof(Record);
+    titleOffset = prereqOffset + header.prereqCount * (sizeof(CourseKey) + sizeof(u_int32_t));
+    while (!heap.empty()) {
+        cursor = heap.top();
+        heap.pop();
+        record.number = cursor.record.number;
+        record.titleOffset = titleOffset;
+        record.titleLength = cursor.record.titleLength;
+        record.prereqOffset = prereqOffset;
+        record.prereqCount = cursor.record.prereqCount;
+        out.write((const char *)&record, sizeof(record));
+        keysOut.write(cursor.next, record.prereqCount * sizeof(CourseKey));
+        cursor.next += record.prereqCount * sizeof(CourseKey);
+        titlesOut.write(cursor.next, record.titleLength);
+        cursor.next += record.titleLength;
+        titleOffset += record.titleLength;
+        prereqOffset += record.prereqCount * sizeof(CourseKey);
+        if (cursor.next < cursor.end) {
+            memcpy(&cursor.record, cursor.next, sizeof(RunRecord));
+            cursor.next += sizeof(RunRecord);
+            heap.push(cursor);
+        }
+    }
+    input.close();
+    out.close();
+    keysOut.close();
+    titlesOut.close();
+    if (!out || !keysOut || !titlesOut)
+        fail("write snapshot " + path);
+
+    // Append the keys, then a link for each of them, then the titles
+    if (!merged.open(tmpPath) || !keys.open(keysPath) || !titles.open(titlesPath))
+        fail("read snapshot " + path);
+    out.open(tmpPath, ios::binary | ios::app);
+    if (!out)
+        fail("write snapshot " + path);
+    out.write(keys.view().data(), keys.view().size());
+    records = (const Record *)(merged.view().data() + sizeof(Header));
+    key = (const CourseKey *)keys.view().data();
+    for (i = 0; i < header.courseCount; i++) {
+        for (j = 0; j < records[i].prereqCount; j++, key++) {
+            const Record *found = lower_bound(records, records + header.courseCount, *key,
+                    [](const Record &record, CourseKey k) { return record.number < k; });
+            u_int32_t     target = found - records;
+
+            if (found == records + header.courseCount || found->number != *key) {
+                cerr << "Prerequisite course " << *key
+                     << " of " << records[i].number << " does not exist" << endl;
+                missing++;
+            }
+            out.write((const char *)&target, sizeof(target));
+        }
+    }
+    out.write(titles.view().data(), titles.view().size());
+    out.close();
+    merged.close();
+    keys.close();
+    titles.close();
+    remove(keysPath.c_str());
+    remove(titlesPath.c_str());
+    if (!out)
+        fail("write snapshot " + path);
+    if (missing > 0) {
+        cleanUp();
+        return false;
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0)
+        fail("write snapshot " + path);
+    return true;
+}
+
+/**
+ * Replaces the contents of `index` with the catalog held in a snapshot. The
+ * snapshot is mapped into memory and the mapping is handed to the index's
+ * arena, so the titles and prerequisite lists are used directly from it.
+ *
+ * \param path the snapshot to load
+ * \param index the index to load it into
+ * \param source the details of the csv file, to check the snapshot against
+ * \return the number of courses loaded, or 0 if there is no usable snapshot
+ */
+size_t Snapshot::load(const string &path, CourseIndex *index, const struct stat &source) {
+    shared_ptr<MappedFile> file = make_shared<MappedFile>();
+    string_view            data;
+    Header                 expected;
+    const Header          *header;
+    const Record          *records;
+    const u_int32_t       *links;
+    vector<Course>         courses;
+    vector<const Course *> byRecord;
+    const Course         **linkData;
+    u_int64_t              i;
+
+    if (!file->open(path))
+        return 0;
+    data = file->view();
+    if (data.size() < sizeof(Header))
+        return 0;
+
+    // Everything except the counts has to match what we would have written
+    header = (const Header *)data.data();
+    fillHeader(expected, source);
+    if (memcmp(header, &expected, offsetof(Header, courseCount)) != 0)
+        return 0;
+    if (header->courseCount == 0 || data.size() != sizeof(Header)
+            + header->courseCount * sizeof(Record)
+            + header->prereqCount * (sizeof(CourseKey) + sizeof(u_int32_t))
+            + header->titleBytes)
+        return 0;
+
+    records = (const Record *)(header + 1);
+    links = (const u_int32_t *)(data.data() + sizeof(Header)
+            + header->courseCount * sizeof(Record) + header->prereqCount * sizeof(CourseKey));
+    for (i = 0; i < header->prereqCount; i++) {
+        if (links[i] >= header->courseCount)
+            return 0;
+    }
+    courses.resize(header->courseCount);
+    for (i = 0; i < header->courseCount; i++) {
+        const Record &record = records[i];
+
+        // Guard against a corrupt record pointing outside of the file
+        if (record.titleOffset + record.titleLength > data.size()
+                || record.prereqOffset + record.prereqCount * sizeof(CourseKey) > data.size())
+            return 0;
+        courses[i].number = record.number;
+        courses[i].title = data.substr(record.titleOffset, record.titleLength);
+        courses[i].prerequisites.data = (CourseKey *)(data.data() + record.prereqOffset);
+        courses[i].prerequisites.size = record.prereqCount;
+    }
+
+    index->drain();
+    index->getArena()->retain(file);
+
+    // The link arrays have to be writable, so they are allocated in the arena
+    // rather than used from the mapping
+    linkData = index->getArena()->allocateArray<const Course *>(header->prereqCount);
+    for (i = 0; i < header->courseCount; i++) {
+        courses[i].prerequisiteLinks.data = linkData
+            + (courses[i].prerequisites.data - courses[0].prerequisites.data);
+        courses[i].prerequisiteLinks.size = courses[i].prerequisites.size;
+    }
+    index->Build(courses);
+
+    /* The records were written in index order, so walking the new index visits
+     * them in the same order, which gives us the address of each record's
+     * course. The stored record numbers can then be turned straight back into
+     * links. */
+    byRecord.reserve(header->courseCount);
+    index->ForEach([&](const Course &course) {
+        byRecord.push_back(&course);
+    });
+    for (i = 0; i < header->prereqCount; i++)
+        linkData[i] = byRecord[links[i]];
+    return header->courseCount;
+}
+
+/**
+ * An enum representing valid choices for user input to the main menu
+ */
+typedef enum {
+    LoadCourses    = 1,
+    DisplayCourses = 2,
+    FindCourse     = 3,
+    ListCourses    = 4,
+    PlanSchedule   = 5,
+    FindDependents = 6,
+    Exit           = 9,
+}   MenuChoice;
+
+/**
+ * An enum representing the ways the index can be populated from the csv file
+ */
+typedef enum {
+    LoadInsert = 1, // insert each course as it is parsed
+    LoadBulk   = 2, // collect all of the courses, then build the index in one pass
+    LoadStream = 3, // read the file a chunk at a time, inserting and resolving as it goes
+}   LoadMode;
+
+/**
+ * The runtime configuration of the program, filled in from the command line
+ */
+struct Options {
+    vector<string> csvPaths;                                 // the csv data files, read as one
+    IndexEngine engine     = DEFAULT_INDEX_ENGINE;             // the index engine to use
+    LoadMode    loadMode   = LoadBulk;                         // how the index is populated
+    u_int64_t   tableSize  = DEFAULT_PREREQUISITE_TABLE_SIZE;  // initial prerequisite table capacity
+    double      loadFactor = DEFAULT_PREREQUISITE_LOAD_FACTOR; // prerequisite table load factor
+    string      batchPath;                                   // file of course numbers to look up
+                                                             // non-interactively, "-" for stdin
+    string      snapshotPath;                                // where to cache the validated catalog
+    unsigned    threads    = 0;                              // parser threads, 0 for one per core
+    bool        closure    = false;                          // list every indirect prerequisite
+                                                             // in batch results too
+    bool        dependents = false;                          // list the courses which depend on
+                                                             // each one in batch results too
+    bool        plan       = false;                          // batch queries are lists of
+                                                             // courses to plan semesters for
+    u_int32_t   termCap    = DEFAULT_TERM_CAP;               // most courses per semester, 0 no limit
+    int         bench      = 0;                              // benchmark catalogs of up to 10^N
+                                                             // courses instead, 0 not to
+    string      statsPath;                                   // where to write the stats of each
+                                                             // load as JSON, "-" for stderr
+    u_int64_t   memoryBudget = 0;                            // bytes of courses a streamed load
+                                                             // may hold before writing them out
+                                                             // in runs, 0 no limit
+    bool        background = false;                          // load from the menu on a worker
+                                                             // thread, keeping the menu usable
+    bool        shard      = false;                          // keep one index per department
+};
+
+/**
+ * Splits the next line off the front of `data`. One scan finds both the end of
+ * the line and every field in it.
+ * \param data the remaining data, which is advanced past the line
+ * \param commas filled in with the position of every comma in the line
+ * \return a view of the line, without its line feed
+ */
+static string_view nextLine(string_view &data, vector<u_int32_t> &commas) {
+    size_t      length = CsvScanner::scanLine(data, commas);
+    string_view line = data.substr(0, length);
+
+    data.remove_prefix(min(length + 1, data.size()));
+    return line;
+}
+
+/**
+ * Parses every line of csv data into a list of courses
+ * \param data the csv data, which must start at the beginning of a line
+ * \param arena where the courses' data is stored
+ * \param table where the prerequisites are collected
+ * \param courses the list to add the parsed courses to
+ * \param progress counts the bytes parsed, every `PROGRESS_LINES` lines
+ */
+static void parseLines(string_view data, Arena *arena, PrereqHashTable *table,
+        vector<Course> &courses, atomic<u_int64_t> *progress) {
+    vector<u_int32_t> commas;
+    size_t            unreported = data.size();
+    u_int32_t         lines = 0;
+
+    while (!data.empty()) {
+        Course course;
+        string_view line = nextLine(data, commas);
+
+        course.init(line, commas, table, arena);
+        courses.push_back(std::move(course));
+        if (++lines % PROGRESS_LINES == 0) {
+            progress->fetch_add(unreported - data.size(), memory_order_relaxed);
+            unreported = data.size();
+        }
+    }
+    progress->fetch_add(unreported, memory_order_relaxed);
+}
+
+typedef chrono::steady_clock Clock; // The clock every timing is taken from
+
+/**
+ * Gets the time since `start`
+ * \param start when the timing started
+ * \return the elapsed time, in seconds
+ */
+static double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * How long each phase of the last load of a catalog took, in seconds
+ */
+struct LoadTimings {
+    const char *source   = "none"; // "csv", "snapshot", "reload" or "refresh"
+    double      read     = 0;      // finding and mapping the file
+    double      parse    = 0;      // splitting the lines into courses
+    double      insert   = 0;      // building or changing the index
+    double      validate = 0;      // checking the prerequisites and ordering the courses
+    double      spill    = 0;      // writing a streamed catalog out in runs, merging them
+                                   // and mapping the result back in
+};
+
+/**
+ * A summary of how a reload changed the catalog
+ */
+struct CatalogChanges {
+    size_t added   = 0; // courses which are new in the csv file
+    size_t updated = 0; // courses whose title or prerequisites changed
+    size_t removed = 0; // courses which are no longer in the csv file
+};
+
+/**
+ * How far a load has got, as seen from another thread while it runs
+ */
+struct LoadProgress {
+    const char *stage  = "starting"; // "reading", "parsing", "building" or "validating"
+    u_int64_t   parsed = 0;          // bytes of the csv file parsed so far
+    u_int64_t   size   = 0;          // bytes in the csv file, 0 until it has been found
+};
+
+/**
+ * Scratch space for one thread's searches over a catalog, indexed by course
+ * id. Starting a search bumps the generation, which clears every mark at once,
+ * so a search only ever costs as much as the courses it actually touches.
+ */
+struct SearchMarks {
+    vector<u_int32_t> marks;          // The generation in which each course was marked
+    vector<u_int32_t> values;         // A value for each course, only meaningful while marked
+    u_int32_t         generation = 0; // The current search
+
+    /**
+     * Starts a new search, clearing every mark
+     * \param courses the number of courses in the catalog being searched
+     */
+    void begin(size_t courses) {
+        if (marks.size() < courses) {
+            marks.resize(courses, 0);
+            values.resize(courses, 0);
+        }
+        if (++generation == 0) {
+            fill(marks.begin(), marks.end(), 0);
+            generation = 1;
+        }
+    }
+
+    bool marked(const Course *course) const { return marks[course->id] == generation; }
+    void mark(const Course *course) { marks[course->id] = generation; }
+    u_int32_t &value(const Course *course) { return values[course->id]; }
+
+    /**
+     * Gets the calling thread's own scratch space
+     */
+    static SearchMarks &local() {
+        thread_local SearchMarks scratch;
+        return scratch;
+    }
+};
+
+/**
+ * A complete catalog of courses: the index, and the prerequisites table which
+ * was used to validate it. A catalog is built by `load`, and a catalog whose
+ * index can be changed is then reloaded in place by `refresh`. That does
+ * everything up to applying the changes while the catalog is still being
+ * read, and then waits for exclusive use of it. Every query is private and
+ * can only be made through a `Pinned` handle, so nothing can read the catalog
+ * without either pinning it, which holds a reader lock for as long as the
+ * handle lives, or freezing it, which rules out any further refresh. A catalog
+ * with a read-only index is never changed once loaded: reloading builds a
+ * whole new catalog on the side, and `reload` uses the previous catalog to do
+ * as little of that work as possible.
+ */
+class Catalog {
+    public:
+        typedef vector<const Course*> CourseList; // A list of courses, in some order
+
+    private:
+        typedef vector<pair<const Course*, u_int32_t>> Path; // A depth first search path,
+                                      // holding each course and the next edge to follow
+        CourseIndex     *index;       // The index where course information will be stored
+        PrereqHashTable *prereqTable; // The hash table where prerequisites will be stored
+                                      // to validate that they match to actual courses
+        size_t           size;        // The number of courses in the catalog
+        struct stat      source;      // The details of the csv file when it was loaded
+        CourseList       order;       // Every course, each one after all of its prerequisites
+        unique_ptr<atomic<const CourseList*>[]> closures; // Each course's memoized
+                                      // closure, by id, or NULL until it is first asked for
+        vector<u_int32_t>     dependentOffsets; // Where each course's dependents start
+                                      // in `dependentLinks`, by id, with one extra at the end
+        vector<const Course*> dependentLinks;   // Every course's dependents, one after another
+        LoadTimings      timings;     // How long the last load took
+
+        /**
+         * An inverted index of the words in every title. Each distinct word
+         * has a run of postings, which are the courses with that word in their
+         * title, in prerequisite order. The words are kept sorted so that a
+         * partly typed word can be looked up as a range.
+         */
+        struct TitleIndex {
+            /**
+             * A word, and where its postings are
+             */
+            struct Word {
+                string_view text;  // The word, in lower case, pointing into `text`
+                u_int32_t   first; // The first of its postings
+                u_int32_t   count; // The number of postings
+            };
+
+            string                text;     // Every title in lower case, one after another
+            vector<Word>          words;    // Every distinct word, sorted
+            vector<const Course*> postings; // Every word's postings, one after another
+        };
+        mutable atomic<const TitleIndex*> titles; // Built the first time titles are searched
+
+        /**
+         * A small cache of rendered course details, for the handful of courses
+         * which most lookups are for. It is split into `DETAILS_CACHE_SETS`
+         * sets (a power of 2), picked by hashing the course number, and each
+         * set holds `DETAILS_CACHE_WAYS` courses behind its own lock so that
+         * reader threads rarely wait on each other. A full set evicts with the
+         * CLOCK algorithm: the hand skips (and clears) any slot which has been
+         * hit since it last passed, and takes the first one which has not.
+         */
+        struct DetailsCache {
+            /**
+             * A cached course, with its details as `renderDetails` writes them
+             */
+            struct Slot {
+                const Course *course = nullptr; // The course, or NULL when unused
+                string        details;          // The course's rendered details
+                bool          referenced = false; // Hit since the hand last passed
+            };
+
+            /**
+             * One set of slots, and the CLOCK hand which sweeps them
+             */
+            struct Set {
+                mutex     lock;
+                Slot      slots[DETAILS_CACHE_WAYS];
+                u_int32_t hand = 0;
+            };
+
+            Set sets[DETAILS_CACHE_SETS];
+        };
+        mutable DetailsCache details; // Emptied whenever the courses are renumbered
+        atomic<const char*> stage;    // What the load in progress is doing
+        atomic<u_int64_t>   parsed;   // The bytes of the csv file it has parsed so far
+        atomic<u_int64_t>   fileSize; // The bytes in the csv file it is loading
+        mutable shared_mutex changing; // Shared by pinned readers, and exclusive while a
+                                      // refresh applies its changes
+        mutable atomic<bool> frozen;  // Set by `freeze`, after which nothing may refresh
+
+        const TitleIndex &getTitles() const; // Builds the title index, if it is not already
+        void   clearTitles();         // Frees the title index
+        void   clearDetails();        // Empties the details cache
+
+        size_t orderCourses();        // Sorts the courses into prerequisite order, reporting
+                                      // any cycles
+        size_t findNewCycles(const vector<size_t> &changed, const vector<Course> &batch,
+                PrereqHashTable &changedKeys); // Checks a refresh for cycles before applying it
+        static void reportCycle(const Path &path, const Course *target); // Reports a cycle
+        static void renderList(string_view label, const Course *const *begin,
+                const Course *const *end, string &out); // Renders a labelled list of courses
+        void   clearClosures();       // Frees every memoized closure
+        void   indexDependents();     // Builds the reverse of the prerequisite links
+        bool resolvePrerequisites();  // Links every prerequisite to its course,
+                                      // reporting any which do not exist
+        bool linkPrerequisites();     // Links every prerequisite once the table is resolved
+        bool stream(const Options &options); // Reads, inserts and resolves the courses a
+                                      // chunk at a time, spilling them past the budget
+        void spill(const Options &options, const string &runsPath,
+                const vector<Snapshot::Run> &runs); // Merges the spilled runs into a
+                                      // mapped file and loads the catalog from it
+        static void parse(const vector<string_view> &sources, unsigned threads, Arena *arena,
+                PrereqHashTable *table, vector<Course> &batch,
+                atomic<u_int64_t> *progress); // Parses the csv data, in parallel when
+                                      // it is large enough
+        void saveSnapshot(const Options &options) const; // Caches the catalog, if enabled
+
+        friend class Benchmark;       // Times the load phases on their own
+
+        // Every query is private, and is only reachable through a `Pinned` handle
+        const CourseIndex *getIndex() const; // Getter for the `index` field
+        const Course *Search(CourseKey courseNumber) const; // Looks up a single course
+        void   SearchMany(const CourseKey *courseNumbers, size_t count,
+                const Course **results) const; // Looks up a batch of courses at once
+        const CourseList &getOrder() const; // Getter for the `order` field
+        const CourseList &Closure(const Course &course) const; // Every direct and indirect
+                                      // prerequisite of `course`, in prerequisite order
+        void   renderClosure(const Course &course, string &out) const; // Renders `Closure`
+        void   Plan(const CourseList &targets, u_int32_t cap, vector<CourseList> &terms) const;
+                                      // Schedules courses into terms, prerequisites first
+        ArenaArray<const Course*> Dependents(const Course &course) const; // The courses which
+                                      // require `course` directly
+        void   Impact(const Course &course, CourseList &affected) const; // Every course which
+                                      // requires `course`, directly or indirectly
+        void   renderDependents(const Course &course, string &out) const; // Renders both
+        const Course *renderDetails(CourseKey courseNumber, string &out) const; // Looks up
+                                      // and renders a course, from the cache if it is there
+        void   SearchTitles(string_view query, CourseList &matches) const; // Finds the courses
+                                      // with every word of `query` in their title
+
+    public:
+        /**
+         * The only way to read a catalog. A handle from `pin` holds a reader
+         * lock, so a refresh cannot change the catalog until the handle goes;
+         * one from `freeze` holds no lock, as the catalog it comes from can
+         * never be refreshed again. Either way, a reader which has not taken a
+         * handle has nothing to read the catalog through.
+         */
+        class Pinned {
+            private:
+                const Catalog            *catalog; // The catalog being read
+                shared_lock<shared_mutex> lock;    // Held for as long as the handle is,
+                                                   // unless the catalog is frozen
+
+            public:
+                Pinned(const Catalog *catalog, shared_lock<shared_mutex> &&lock)
+                    : catalog(catalog), lock(std::move(lock)) {}
+
+                const CourseIndex *getIndex() const { return catalog->getIndex(); }
+                const Course *Search(CourseKey courseNumber) const {
+                    return catalog->Search(courseNumber);
+                }
+                void SearchMany(const CourseKey *courseNumbers, size_t count,
+                        const Course **results) const {
+                    catalog->SearchMany(courseNumbers, count, results);
+                }
+                const CourseList &getOrder() const { return catalog->getOrder(); }
+                const CourseList &Closure(const Course &course) const {
+                    return catalog->Closure(course);
+                }
+                void renderClosure(const Course &course, string &out) const {
+                    catalog->renderClosure(course, out);
+                }
+                void Plan(const CourseList &targets, u_int32_t cap,
+                        vector<CourseList> &terms) const {
+                    catalog->Plan(targets, cap, terms);
+                }
+                ArenaArray<const Course*> Dependents(const Course &course) const {
+                    return catalog->Dependents(course);
+                }
+                void Impact(const Course &course, CourseList &affected) const {
+                    catalog->Impact(course, affected);
+                }
+                void renderDependents(const Course &course, string &out) const {
+                    catalog->renderDependents(course, out);
+                }
+                const Course *renderDetails(CourseKey courseNumber, string &out) const {
+                    return catalog->renderDetails(courseNumber, out);
+                }
+                void SearchTitles(string_view query, CourseList &matches) const {
+                    catalog->SearchTitles(query, matches);
+                }
+        };
+
+        Catalog(const Options &options); // Constructor, creates an empty catalog
+        Catalog(const Catalog &) = delete;
+        Catalog &operator=(const Catalog &) = delete;
+        virtual ~Catalog();              // Destructor
+        void   load(const Options &options); // Loads the courses from the csv files or snapshot
+        CatalogChanges reload(const Catalog &previous, const Options &options); // Loads the
+                                         // courses, reusing what has not changed since `previous`
+        CatalogChanges refresh(const Options &options); // Applies the changes in the csv
+                                         // files in place, waiting for every pin to be released
+        Pinned pin() const;              // Keeps a refresh from changing the catalog until
+                                         // the handle is released
+        Pinned freeze() const;           // Keeps any refresh from changing the catalog ever
+                                         // again, for readers which do not pin
+        bool   isLoadedFrom(const struct stat &csv) const; // Checks whether the csv file has
+                                         // changed since it was loaded
+        size_t getSize() const;          // Getter for the `size` property
+        bool   isReadOnly() const;       // Whether the index can only be built, not changed
+        static void renderPlan(const vector<CourseList> &terms, string &out); // Renders `Plan`
+        LoadProgress getProgress() const; // How far a load has got, safe to call from any
+                                         // thread while it runs
+        void   renderStats(string &out) const; // Renders the load timings, and the shape of
+                                         // the index and prerequisites table, as JSON
+};
+
+/**
+ * Constructor
+ * \param options the runtime configuration, which selects the index engine and
+ * the size of the prerequisites table
+ */
+Catalog::Catalog(const Options &options)
+    : titles(nullptr), stage("starting"), parsed(0), fileSize(0), frozen(false) {
+    size = 0;
+    memset(&source, 0, sizeof(source));
+    prereqTable = new PrereqHashTable(options.tableSize, options.loadFactor);
+    try {
+        index = options.shard ? new ShardedIndex(options.engine, options.threads)
+                              : CourseIndex::create(options.engine);
+    } catch (...) {
+        delete prereqTable;
+        throw;
+    }
+}
+
+/**
+ * Destructor
+ */
+Catalog::~Catalog() {
+    clearClosures();
+    clearTitles();
+    // Delete the hash table and index which we allocated on the heap
+    delete prereqTable;
+    delete index;
+}
+
+/**
+ * Getter
+ * \return the number of courses in the catalog
+ */
+size_t Catalog::getSize() const {
+    return size;
+}
+
+/**
+ * Checks whether this catalog was loaded from the current version of the csv
+ * file, going by its size and modification time
+ * \param csv the details of the csv file as it is now
+ * \return true if the csv file has not changed since it was loaded
+ */
+bool Catalog::isLoadedFrom(const struct stat &csv) const {
+    return size > 0 && source.st_size == csv.st_size &&
+        Snapshot::modificationTime(source) == Snapshot::modificationTime(csv);
+}
+
+/**
+ * Getter
+ * \return the index holding the courses
+ */
+const CourseIndex *Catalog::getIndex() const {
+    return index;
+}
+
+/**
+ * Checks the kind of index, which never changes, so this needs no pin
+ * \return true if the index can only be built in bulk, and so can never be
+ * refreshed in place
+ */
+bool Catalog::isReadOnly() const {
+    return index->isReadOnly();
+}
+
+/**
+ * Looks up a course by number
+ * \param courseNumber the course to look for
+ * \return the course, or NULL if there is none
+ */
+const Course *Catalog::Search(CourseKey courseNumber) const {
+    return index->Search(courseNumber);
+}
+
+/**
+ * Looks up a batch of courses at once, which is quicker than looking them up
+ * one at a time as the index can work on several at once
+ * \param courseNumbers the course numbers to look for
+ * \param count the number of course numbers
+ * \param results filled in with the matching course for each number, or NULL
+ */
+void Catalog::SearchMany(const CourseKey *courseNumbers, size_t count,
+        const Course **results) const {
+    index->SearchMany(courseNumbers, count, results);
+}
+
+/**
+ * Getter
+ * \return every course, with each one after all of its prerequisites
+ */
+const Catalog::CourseList &Catalog::getOrder() const {
+    return order;
+}
+
+/**
+ * Frees every memoized closure
+ */
+void Catalog::clearClosures() {
+    size_t i;
+
+    if (closures == nullptr)
+        return;
+    for (i = 0; i < order.size(); i++)
+        delete closures[i].load();
+    closures.reset();
+}
+
+/**
+ * Reports a prerequisite cycle, which is the part of the search path from
+ * `target` to the end, followed by `target` again
+ * \param path the current depth first search path
+ * \param target the course which the last course on the path requires, and
+ * which is already on the path
+ */
+void Catalog::reportCycle(const Path &path, const Course *target) {
+    size_t i = path.size();
+
+    while (i > 0 && path[i - 1].first->number != target->number)
+        i--;
+    cerr << "Prerequisite cycle:";
+    for (i = i > 0 ? i - 1 : 0; i < path.size(); i++)
+        cerr << " " << path[i].first->number << " ->";
+    cerr << " " << target->number << endl;
+}
+
+/**
+ * Sorts the courses so that every course comes after all of its prerequisites,
+ * and numbers each course by its position in that order. This is a depth first
+ * search over the prerequisite links, which adds each course once all of its
+ * prerequisites have been added, so it takes O(V + E). The search is iterative,
+ * with an explicit path, as a chain of prerequisites can be far deeper than the
+ * call stack. Reaching a course which is still on the path means the catalog
+ * has a cycle, and every cycle found is reported.
+ *
+ * A cyclic catalog would send any traversal of the prerequisites round in
+ * circles forever, which is why it does not pass validation.
+ *
+ * \return the number of cycles found
+ */
+size_t Catalog::orderCourses() {
+    CourseList            courses;
+    vector<unsigned char> state; // 0 unvisited, 1 on the path, 2 done
+    Path                  path;
+    size_t                cycles;
+    size_t                i;
+
+    clearClosures();
+    clearTitles();
+    clearDetails();
+    order.clear();
+    // Number the courses in index order for the search itself
+    courses.reserve(size);
+    index->ForEach([&](const Course &course) {
+        course.id = courses.size();
+        courses.push_back(&course);
+    });
+    state.assign(courses.size(), 0);
+    order.reserve(courses.size());
+
+    cycles = 0;
+    for (const Course *root : courses) {
+        if (state[root->id] != 0)
+            continue;
+        state[root->id] = 1;
+        path.emplace_back(root, 0);
+        while (!path.empty()) {
+            const Course *course = path.back().first;
+
+            if (path.back().second < course->prerequisiteLinks.size) {
+                // Follow the next edge
+                const Course *target = course->prerequisiteLinks[path.back().second++];
+                if (state[target->id] == 0) {
+                    state[target->id] = 1;
+                    path.emplace_back(target, 0);
+                } else if (state[target->id] == 1) {
+                    reportCycle(path, target);
+                    cycles++;
+                }
+            } else {
+                // Every prerequisite is done, so this course can follow them
+                state[course->id] = 2;
+                order.push_back(course);
+                path.pop_back();
+            }
+        }
+    }
+
+    // Renumber by prerequisite order, and make room for the closures
+    for (i = 0; i < order.size(); i++)
+        order[i]->id = i;
+    closures.reset(new atomic<const CourseList*>[order.size()]);
+    for (i = 0; i < order.size(); i++)
+        closures[i].store(nullptr);
+    if (cycles == 0)
+        indexDependents();
+    return cycles;
+}
+
+/**
+ * Builds the reverse of the prerequisite links, so that the courses which
+ * require a course can be found without looking at any others. This is stored
+ * the same way as a compressed sparse row matrix: every course's dependents
+ * are laid out one after another in a single array, in prerequisite order, and
+ * a second array says where each course's run starts. It is built by counting
+ * each course's dependents, then filling them in, which takes O(V + E). The
+ * arrays are kept in vectors rather than the arena, as they are rebuilt every
+ * time the catalog is refreshed in place and the arena is never reset, so a
+ * long running process would otherwise keep every old copy. Reassigning them
+ * reuses their memory whenever it is big enough. A course which lists the same
+ * prerequisite twice is only counted as its dependent once.
+ */
+void Catalog::indexDependents() {
+    vector<u_int32_t> next;
+    size_t            i;
+
+    auto repeated = [](const Course *course, const Course **link) {
+        return find(course->prerequisiteLinks.begin(), link, *link) != link;
+    };
+
+    dependentOffsets.assign(order.size() + 1, 0);
+    for (const Course *course : order) {
+        for (const Course **link = course->prerequisiteLinks.begin();
+                link != course->prerequisiteLinks.end(); link++) {
+            if (!repeated(course, link))
+                dependentOffsets[(*link)->id + 1]++;
+        }
+    }
+    for (i = 1; i < dependentOffsets.size(); i++)
+        dependentOffsets[i] += dependentOffsets[i - 1];
+
+    dependentLinks.resize(dependentOffsets[order.size()]);
+    next.assign(dependentOffsets.begin(), dependentOffsets.end() - 1);
+    // Going through the courses in order leaves every run in order too
+    for (const Course *course : order) {
+        for (const Course **link = course->prerequisiteLinks.begin();
+                link != course->prerequisiteLinks.end(); link++) {
+            if (!repeated(course, link))
+                dependentLinks[next[(*link)->id]++] = course;
+        }
+    }
+}
+
+/**
+ * Finds the courses which require a course directly
+ * \param course a course in this catalog
+ * \return the courses which list `course` as a prerequisite, in prerequisite
+ * order. The array belongs to the catalog.
+ */
+ArenaArray<const Course*> Catalog::Dependents(const Course &course) const {
+    ArenaArray<const Course*> dependents;
+
+    // ArenaArray has no const view, but what is handed out here is only read
+    dependents.data = const_cast<const Course**>(dependentLinks.data())
+            + dependentOffsets[course.id];
+    dependents.size = dependentOffsets[course.id + 1] - dependentOffsets[course.id];
+    return dependents;
+}
+
+/**
+ * Finds every course which requires a course, directly or indirectly, which
+ * is everything affected if that course were retired. This is a search over
+ * the dependents index, so it takes time proportional to the courses found
+ * and their own dependents, rather than a scan of the whole catalog.
+ * \param course a course in this catalog
+ * \param affected filled in with the dependents, in prerequisite order
+ */
+void Catalog::Impact(const Course &course, CourseList &affected) const {
+    SearchMarks &seen = SearchMarks::local();
+    size_t       next;
+
+    affected.clear();
+    seen.begin(order.size());
+    seen.mark(&course);
+    affected.push_back(&course);
+    // `affected` doubles as the search queue
+    for (next = 0; next < affected.size(); next++) {
+        for (const Course *dependent : Dependents(*affected[next])) {
+            if (!seen.marked(dependent)) {
+                seen.mark(dependent);
+                affected.push_back(dependent);
+            }
+        }
+    }
+    affected.erase(affected.begin());
+    sort(affected.begin(), affected.end(), [](const Course *a, const Course *b) {
+        return a->id < b->id;
+    });
+}
+
+/**
+ * Renders the courses which depend on a course onto the end of `out`. The
+ * direct dependents are always listed, and every indirect one as well when
+ * there are any.
+ * \param course a course in this catalog
+ * \param out where the lists are rendered
+ */
+void Catalog::renderDependents(const Course &course, string &out) const {
+    ArenaArray<const Course*> direct = Dependents(course);
+    CourseList                affected;
+
+    if (direct.empty())
+        return;
+    renderList("Required by:", direct.begin(), direct.end(), out);
+    Impact(course, affected);
+    if (affected.size() > direct.size)
+        renderList("All dependents:", affected.data(), affected.data() + affected.size(), out);
+}
+
+/**
+ * Empties the details cache, which has to be done whenever the courses change
+ * under it. The catalog is only ever changed while nothing else is reading it.
+ */
+void Catalog::clearDetails() {
+    for (DetailsCache::Set &set : details.sets) {
+        for (DetailsCache::Slot &slot : set.slots) {
+            slot.course = nullptr;
+            slot.details.clear();
+            slot.referenced = false;
+        }
+        set.hand = 0;
+    }
+}
+
+/**
+ * Looks up a course and renders its details, exactly as `Course::renderDetails`
+ * would. The rendered details of recently looked up courses are kept in the
+ * details cache, so a repeat lookup of a popular course costs neither a search
+ * of the index nor formatting it again.
+ *
+ * A course is cached on its first lookup but not marked as referenced, so a
+ * course which is only ever looked up once is the first to be evicted, and
+ * only a course which is hit again survives the hand going past it.
+ *
+ * \param courseNumber the course to look up
+ * \param out where the course's details are rendered
+ * \return the course, or NULL if there is none (and nothing is rendered)
+ */
+const Course *Catalog::renderDetails(CourseKey courseNumber, string &out) const {
+    DetailsCache::Set &set = details.sets[courseNumber.hash(0, DETAILS_CACHE_SETS)];
+    const Course      *course;
+    size_t             start;
+    u_int32_t          i;
+
+    {
+        lock_guard<mutex> guard(set.lock);
+
+        for (DetailsCache::Slot &slot : set.slots) {
+            if (slot.course != nullptr && slot.course->number == courseNumber) {
+                slot.referenced = true;
+                out += slot.details;
+                return slot.course;
+            }
+        }
+    }
+
+    // Search and render without holding the lock
+    course = index->Search(courseNumber);
+    if (course == nullptr)
+        return nullptr;
+    start = out.size();
+    course->renderDetails(out);
+
+    lock_guard<mutex> guard(set.lock);
+    // Another thread may have cached it in the meantime
+    for (i = 0; i < DETAILS_CACHE_WAYS; i++) {
+        if (set.slots[i].course == course)
+            return course;
+    }
+    while (set.slots[set.hand].referenced) {
+        set.slots[set.hand].referenced = false;
+        set.hand = (set.hand + 1) % DETAILS_CACHE_WAYS;
+    }
+    DetailsCache::Slot &victim = set.slots[set.hand];
+    victim.course = course;
+    victim.details.assign(out, start, string::npos);
+    set.hand = (set.hand + 1) % DETAILS_CACHE_WAYS;
+    return course;
+}
+
+/**
+ * Pins the catalog as it is, so that a refresh running on another thread
+ * cannot apply its changes until the handle is released. A refresh only needs
+ * the catalog to itself while it applies its changes, so a pinned reader holds
+ * it up, or is held up by it, for no longer than that.
+ * \return the handle to read through, which the caller holds for as long as it
+ * is reading
+ */
+Catalog::Pinned Catalog::pin() const {
+    return Pinned(this, shared_lock<shared_mutex>(changing));
+}
+
+/**
+ * Freezes the catalog as it is for good, for readers such as batch mode's
+ * threads which would rather not take a lock for every query. Any refresh
+ * after this throws instead of changing the catalog, so it is only for a
+ * catalog which is no longer going to be reloaded in place.
+ * \return the handle to read through, which holds no lock
+ */
+Catalog::Pinned Catalog::freeze() const {
+    // Waits out a refresh which is already applying its changes
+    unique_lock<shared_mutex> exclusive(changing);
+
+    frozen.store(true, memory_order_release);
+    return Pinned(this, shared_lock<shared_mutex>());
+}
+
+/**
+ * Takes how far a load has got. Only the progress counters are read, so this is
+ * safe to call from another thread while the load runs, though the figures may
+ * each be a moment apart.
+ * \return the stage the load is at, and how much of the csv file it has parsed
+ */
+LoadProgress Catalog::getProgress() const {
+    LoadProgress progress;
+
+    progress.stage = stage.load(memory_order_relaxed);
+    progress.parsed = parsed.load(memory_order_relaxed);
+    progress.size = fileSize.load(memory_order_relaxed);
+    return progress;
+}
+
+/**
+ * Renders how long the last load took, and the shape of the index and of the
+ * prerequisites table, as a single JSON object. A tree whose height is far
+ * above log2 of its size has degenerated, and a long tail in the probe lengths
+ * means that the prerequisites are clustering in the hash table.
+ * \param out the string to render onto the end of
+ */
+void Catalog::renderStats(string &out) const {
+    IndexStats        shape = index->getStats();
+    vector<u_int64_t> probes;
+    char              buf[512];
+    size_t            i;
+
+    prereqTable->getProbeLengths(probes);
+    snprintf(buf, sizeof(buf), "{\"source\":\"%s\",\"courses\":%zu,"
+            "\"seconds\":{\"read\":%.6f,\"parse\":%.6f,\"insert\":%.6f,\"validate\":%.6f,"
+            "\"spill\":%.6f,\"total\":%.6f},\"index\":{\"engine\":\"%s\",\"nodes\":%zu,\"height\":%zu,"
+            "\"average_depth\":%.3f},\"prerequisites\":{\"entries\":%llu,\"capacity\":%llu,"
+            "\"occupancy\":%.4f,\"load_factor\":%.4f,\"resizes\":%llu,\"probe_lengths\":[",
+            timings.source, size, timings.read, timings.parse, timings.insert,
+            timings.validate, timings.spill,
+            timings.read + timings.parse + timings.insert + timings.validate + timings.spill,
+            index->getName(), shape.nodes, shape.height, shape.averageDepth,
+            (unsigned long long)prereqTable->getLength(),
+            (unsigned long long)prereqTable->getCapacity(),
+            prereqTable->getCapacity() == 0 ? 0.0 :
+                (double)prereqTable->getLength() / prereqTable->getCapacity(),
+            prereqTable->getLoadFactor(), (unsigned long long)prereqTable->getResizes());
+    out += buf;
+    for (i = 0; i < probes.size(); i++) {
+        if (i > 0)
+            out += ',';
+        out += to_string(probes[i]);
+    }
+    out += "]}}\n";
+}
+
+/**
+ * Frees the title index
+ */
+void Catalog::clearTitles() {
+    delete titles.exchange(nullptr);
+}
+
+/**
+ * Splits a title, or a query, into lower case words
+ * \param text the text to split, which must already be in lower case
+ * \param word called for each word
+ */
+template <typename Visit>
+static void splitWords(string_view text, Visit word) {
+    size_t start = 0;
+    size_t end;
+
+    for (;;) {
+        while (start < text.size() && !isalnum((unsigned char)text[start]))
+            start++;
+        if (start == text.size())
+            return;
+        for (end = start; end < text.size() && isalnum((unsigned char)text[end]); end++)
+            ;
+        word(text.substr(start, end - start));
+        start = end;
+    }
+}
+
+/**
+ * Gets the title index, building it the first time. Most runs never search by
+ * title, so the index is not built until one does. Building takes a single
+ * pass over the titles and a sort of the words, and it is published with a
+ * compare and swap, so if two threads race to build it one of them simply
+ * throws its copy away.
+ * \return the title index
+ */
+const Catalog::TitleIndex &Catalog::getTitles() const {
+    const TitleIndex            *known = titles.load(memory_order_acquire);
+    unique_ptr<TitleIndex>       built;
+    vector<pair<string_view, const Course*>> pairs;
+    size_t                       length;
+    size_t                       i;
+
+    if (known != nullptr)
+        return *known;
+
+    built = make_unique<TitleIndex>();
+    length = 0;
+    for (const Course *course : order)
+        length += course->title.size() + 1;
+    // Reserving up front means the views into `text` stay valid
+    built->text.reserve(length);
+    for (const Course *course : order) {
+        size_t start = built->text.size();
+
+        for (char c : course->title)
+            built->text += (char)tolower((unsigned char)c);
+        built->text += '\n';
+        splitWords(string_view(built->text).substr(start), [&](string_view word) {
+            pairs.emplace_back(word, course);
+        });
+    }
+    // The courses went in by id, and a stable sort keeps them that way within
+    // each word
+    stable_sort(pairs.begin(), pairs.end(), [](const pair<string_view, const Course*> &a,
+                const pair<string_view, const Course*> &b) {
+        return a.first < b.first;
+    });
+    for (i = 0; i < pairs.size(); i++) {
+        if (built->words.empty() || built->words.back().text != pairs[i].first) {
+            built->words.push_back({ pairs[i].first, (u_int32_t)built->postings.size(), 0 });
+        } else if (built->postings.back() == pairs[i].second) {
+            // The same word twice in one title
+            continue;
+        }
+        built->postings.push_back(pairs[i].second);
+        built->words.back().count++;
+    }
+
+    if (titles.compare_exchange_strong(known, built.get(), memory_order_acq_rel))
+        return *built.release();
+    return *known;
+}
+
+/**
+ * Finds every course which has all of the words in `query` in its title. The
+ * words may be only partly typed, so each matches any word it is the start of,
+ * and "intro algo" finds "Introduction to Algorithms". Each word is found by a
+ * binary search of the title index, and the matching courses are the
+ * intersection of their postings, starting with the shortest, so nothing
+ * outside of the postings is ever looked at.
+ * \param query the words to look for, in any case
+ * \param matches filled in with the matching courses, in prerequisite order
+ */
+void Catalog::SearchTitles(string_view query, CourseList &matches) const {
+    const TitleIndex  &index = getTitles();
+    string             lower;
+    vector<string_view> words;
+    vector<CourseList> candidates;
+    CourseList         next;
+    size_t             i;
+
+    matches.clear();
+    for (char c : query)
+        lower += (char)tolower((unsigned char)c);
+    splitWords(lower, [&](string_view word) {
+        words.push_back(word);
+    });
+    if (words.empty())
+        return;
+
+    auto byId = [](const Course *a, const Course *b) {
+        return a->id < b->id;
+    };
+    for (i = 0; i < words.size(); i++) {
+        auto first = lower_bound(index.words.begin(), index.words.end(), words[i],
+                [](const TitleIndex::Word &w, string_view text) { return w.text < text; });
+
+        candidates.emplace_back();
+        for (auto word = first; word != index.words.end(); word++) {
+            if (word->text.substr(0, words[i].size()) != words[i])
+                break;
+            candidates.back().insert(candidates.back().end(),
+                    index.postings.begin() + word->first,
+                    index.postings.begin() + word->first + word->count);
+        }
+        // A partly typed word can match several words, each with its own postings
+        sort(candidates.back().begin(), candidates.back().end(), byId);
+        candidates.back().erase(unique(candidates.back().begin(), candidates.back().end()),
+                candidates.back().end());
+        if (candidates.back().empty())
+            return;
+    }
+
+    sort(candidates.begin(), candidates.end(), [](const CourseList &a, const CourseList &b) {
+        return a.size() < b.size();
+    });
+    matches = candidates[0];
+    for (i = 1; i < candidates.size() && !matches.empty(); i++) {
+        next.clear();
+        set_intersection(matches.begin(), matches.end(), candidates[i].begin(),
+                candidates[i].end(), back_inserter(next), byId);
+        matches.swap(next);
+    }
+}
+
+/**
+ * Renders a list of course numbers, separated by commas, onto the end of
+ * `out`, as a single line starting with `label`
+ * \param label the start of the line
+ * \param begin the first course in the list
+ * \param end one past the last course in the list
+ * \param out where the list is rendered
+ */
+void Catalog::renderList(string_view label, const Course *const *begin,
+        const Course *const *end, string &out) {
+    char buf[CourseKey::WIDTH];
+
+    out += label;
+    for (const Course *const *course = begin; course != end; course++) {
+        out += course == begin ? " " : ", ";
+        out.append(buf, (*course)->number.write(buf));
+    }
+    out += '\n';
+}
+
+/**
+ * Finds every direct and indirect prerequisite of a course. The first time a
+ * course is asked for this is a depth first search over the prerequisite
+ * links, which does not descend into any prerequisite whose own closure is
+ * already known, but copies it in instead. The result is then memoized, so
+ * every later request for the same course is a single lookup, and requests for
+ * any course which requires it are cheaper.
+ *
+ * Any number of threads can ask for closures at once. Each search has its own
+ * marks, and the result is published with a compare and swap, so if two
+ * threads race to compute the same closure one of them simply throws its copy
+ * away.
+ *
+ * \param course a course in this catalog
+ * \return the prerequisites, each one after all of its own prerequisites
+ */
+const Catalog::CourseList &Catalog::Closure(const Course &course) const {
+    SearchMarks               &seen = SearchMarks::local();
+    atomic<const CourseList*> &slot = closures[course.id];
+    const CourseList          *known = slot.load(memory_order_acquire);
+    unique_ptr<CourseList>     list;
+    CourseList                 stack;
+
+    if (known != nullptr)
+        return *known;
+
+    seen.begin(order.size());
+    list = make_unique<CourseList>();
+    seen.mark(&course);
+    stack.push_back(&course);
+    while (!stack.empty()) {
+        const Course *current = stack.back();
+        stack.pop_back();
+
+        for (const Course *prerequisite : current->prerequisiteLinks) {
+            if (seen.marked(prerequisite))
+                continue;
+            seen.mark(prerequisite);
+            list->push_back(prerequisite);
+
+            known = closures[prerequisite->id].load(memory_order_acquire);
+            if (known == nullptr) {
+                stack.push_back(prerequisite);
+                continue;
+            }
+            for (const Course *indirect : *known) {
+                if (!seen.marked(indirect)) {
+                    seen.mark(indirect);
+                    list->push_back(indirect);
+                }
+            }
+        }
+    }
+    // The ids are positions in prerequisite order
+    sort(list->begin(), list->end(), [](const Course *a, const Course *b) {
+        return a->id < b->id;
+    });
+
+    known = nullptr;
+    if (slot.compare_exchange_strong(known, list.get(), memory_order_acq_rel))
+        return *list.release();
+    return *known;
+}
+
+/**
+ * Renders every direct and indirect prerequisite of a course onto the end of
+ * `out`, in the order they could be taken
+ * \param course a course in this catalog
+ * \param out where the list is rendered
+ */
+void Catalog::renderClosure(const Course &course, string &out) const {
+    const CourseList &all = Closure(course);
+
+    if (!all.empty())
+        renderList("All prerequisites:", all.data(), all.data() + all.size(), out);
+}
+
+/**
+ * Schedules a set of courses into terms, so that every course is taken in a
+ * later term than all of its prerequisites, with at most `cap` courses per
+ * term. Every prerequisite of the targets is scheduled too, whether direct or
+ * indirect.
+ *
+ * This is Kahn's algorithm, run one term at a time. Each course counts down
+ * how many of its prerequisites have still to be taken, and a course becomes
+ * available for the next term once that reaches zero. The courses available
+ * for a term are taken in the order they became available, oldest first, and
+ * whatever does not fit under the cap carries over to the next term. The
+ * dependents of each course are gathered into one flat array first, so each
+ * edge is looked at a constant number of times and the whole plan takes
+ * O(V + E) for the courses involved, however many terms it needs.
+ *
+ * \param targets the courses to plan for, or none for the whole catalog
+ * \param cap the most courses in any one term, 0 for no limit
+ * \param terms filled in with the courses to take in each term, in order
+ */
+void Catalog::Plan(const CourseList &targets, u_int32_t cap, vector<CourseList> &terms) const {
+    SearchMarks       &local = SearchMarks::local();
+    CourseList         courses;
+    vector<u_int32_t>  waiting;    // prerequisites still to be taken, by local position
+    vector<u_int32_t>  offsets;    // where each course's dependents start in `dependents`
+    vector<u_int32_t>  dependents; // local positions of the dependents of every course
+    vector<u_int32_t>  ready;      // local positions of the available courses, in order
+    size_t             next;
+    size_t             i;
+
+    terms.clear();
+    // Finding the closures uses this thread's marks too, so that has to be
+    // done before the marks are used here
+    for (const Course *target : targets)
+        Closure(*target);
+    local.begin(order.size());
+    if (targets.empty()) {
+        courses = order;
+    } else {
+        // Everything which is needed to take the targets
+        for (const Course *target : targets) {
+            if (!local.marked(target)) {
+                local.mark(target);
+                courses.push_back(target);
+            }
+            for (const Course *prerequisite : Closure(*target)) {
+                if (!local.marked(prerequisite)) {
+                    local.mark(prerequisite);
+                    courses.push_back(prerequisite);
+                }
+            }
+        }
+        // Put them in prerequisite order, so they become available in it
+        sort(courses.begin(), courses.end(), [](const Course *a, const Course *b) {
+            return a->id < b->id;
+        });
+    }
+    // Every course has to be found by its local position from now on
+    for (i = 0; i < courses.size(); i++) {
+        local.mark(courses[i]);
+        local.value(courses[i]) = i;
+    }
+
+    // Count every course's dependents, then fill them in
+    waiting.resize(courses.size());
+    offsets.assign(courses.size() + 1, 0);
+    for (i = 0; i < courses.size(); i++) {
+        waiting[i] = courses[i]->prerequisiteLinks.size;
+        for (const Course *prerequisite : courses[i]->prerequisiteLinks)
+            offsets[local.value(prerequisite) + 1]++;
+    }
+    for (i = 0; i < courses.size(); i++)
+        offsets[i + 1] += offsets[i];
+    dependents.resize(offsets.back());
+    for (i = 0; i < courses.size(); i++) {
+        for (const Course *prerequisite : courses[i]->prerequisiteLinks)
+            dependents[offsets[local.value(prerequisite)]++] = i;
+    }
+    // Filling in moved each offset to the start of the next course's dependents
+    for (i = courses.size(); i > 0; i--)
+        offsets[i] = offsets[i - 1];
+    offsets[0] = 0;
+
+    for (i = 0; i < courses.size(); i++) {
+        if (waiting[i] == 0)
+            ready.push_back(i);
+    }
+    next = 0;
+    while (next < ready.size()) {
+        // Only what is available at the start of the term can be taken in it
+        size_t end = ready.size();
+        if (cap > 0 && end - next > cap)
+            end = next + cap;
+
+        terms.emplace_back();
+        for (; next < end; next++) {
+            u_int32_t course = ready[next];
+
+            terms.back().push_back(courses[course]);
+            for (i = offsets[course]; i < offsets[course + 1]; i++) {
+                if (--waiting[dependents[i]] == 0)
+                    ready.push_back(dependents[i]);
+            }
+        }
+    }
+}
+
+/**
+ * Renders a plan onto the end of `out`, one line per term
+ * \param terms the courses to take in each term
+ * \param out where the plan is rendered
+ */
+void Catalog::renderPlan(const vector<CourseList> &terms, string &out) {
+    size_t term;
+
+    for (term = 0; term < terms.size(); term++) {
+        string label = "Semester " + to_string(term + 1) + ":";
+        renderList(label, terms[term].data(), terms[term].data() + terms[term].size(), out);
+    }
+}
+
+/**
+ * Validates that all prerequisites are valid courses, and links each course
+ * directly to its prerequisites. This takes two passes. First every distinct
+ * prerequisite in the hash table is looked up in the index exactly once, in
+ * batches with `SearchMany`, and the result stored in the table. Then each
+ * course's prerequisites are linked by looking them up in the hash table, which
+ * is O(1) per prerequisite rather than another search of the tree. Every
+ * missing prerequisite is reported, rather than stopping at the first.
+ *
+ * \return true if every prerequisite exists
+ */
+bool Catalog::resolvePrerequisites() {
+    const size_t  BATCH = 256;  // prerequisites looked up at once
+    CourseKey     keys[BATCH];
+    const Course *found[BATCH];
+    u_int64_t     slots[BATCH]; // where in the table each of `keys` came from
+    size_t        n;
+    u_int64_t     i;
+    Prerequisite *prerequisites;
+
+    // Get the internal array of prerequisites from the hash table
+    prerequisites = this->prereqTable->getItems();
+
+    auto resolve = [&]() {
+        index->SearchMany(keys, n, found);
+        for (size_t j = 0; j < n; j++)
+            prerequisites[slots[j]].course = found[j];
+        n = 0;
+    };
+    // loop over the array, resolving each distinct prerequisite
+    n = 0;
+    for (i = 0; i < prereqTable->getCapacity(); i++) {
+        // Only check non-empty prerequisites
+        if (prerequisites[i].empty())
+            continue;
+        keys[n] = prerequisites[i].key;
+        slots[n++] = i;
+        if (n == BATCH)
+            resolve();
+    }
+    resolve();
+    return linkPrerequisites();
+}
+
+/**
+ * Links every course to its prerequisites, once every entry in the hash table
+ * has been resolved, reporting each reference to a course which does not
+ * exist. The link array lives in the arena rather than in the (const) course,
+ * so it can be written here.
+ *
+ * \return true if every prerequisite exists
+ */
+bool Catalog::linkPrerequisites() {
+    u_int64_t i;
+    u_int64_t missing;
+
+    missing = 0;
+    index->ForEach([&](const Course &course) {
+        for (i = 0; i < course.prerequisites.size; i++) {
+            Prerequisite *entry = prereqTable->find(course.prerequisites[i]);
+            course.prerequisiteLinks[i] = entry == nullptr ? nullptr : entry->course;
+            if (course.prerequisiteLinks[i] == nullptr) {
+                cerr << "Prerequisite course " << course.prerequisites[i]
+                     << " of " << course.number << " does not exist" << endl;
+                missing++;
+            }
+        }
+    });
+
+    return missing == 0;
+}
+
+/**
+ * Parses the csv data into a list of courses, ready for a bulk build. Anything
+ * smaller than `PARALLEL_CHUNK_SIZE` is parsed on this thread. Otherwise the
+ * data is split into one chunk per thread, each ending at a line boundary, and
+ * each chunk is parsed into its own arena and prerequisite table so that the
+ * threads share nothing. Once they are all done the results are merged in file
+ * order, so the outcome is exactly the same as parsing on a single thread.
+ * Several csv files are cut up the same way, so a file has at least one chunk
+ * of its own, and a pool of the same number of threads claims every file's
+ * chunks in turn, however many files there are.
+ *
+ * \param sources the contents of every csv file
+ * \param threads the number of threads to use, 0 for one per core
+ * \param arena where the courses' data is stored
+ * \param table where the prerequisites are collected
+ * \param batch the list to add the parsed courses to
+ * \param progress counts the bytes parsed, by every thread
+ * \throws runtime_error if any line fails to parse
+ */
+void Catalog::parse(const vector<string_view> &sources, unsigned threads, Arena *arena,
+        PrereqHashTable *table, vector<Course> &batch, atomic<u_int64_t> *progress) {
+    /**
+     * Everything belonging to one thread
+     */
+    struct Chunk {
+        string_view     data;
+        Arena           arena;
+        PrereqHashTable table;
+        vector<Course>  courses;
+        exception_ptr   error;
+
+        Chunk(string_view data, double loadFactor)
+            : data(data), table(DEFAULT_PREREQUISITE_TABLE_SIZE, loadFactor) {}
+    };
+    vector<unique_ptr<Chunk>> chunks;
+    vector<thread>            workers;
+    atomic<size_t>            claimed(0);
+    unsigned                  n;
+    size_t                    size;
+    size_t                    pos;
+    u_int64_t                 i;
+
+    size = 0;
+    for (string_view data : sources)
+        size += data.size();
+    n = threads == 0 ? thread::hardware_concurrency() : threads;
+    n = min<size_t>(max(n, 1u), size / PARALLEL_CHUNK_SIZE + 1);
+    if (n == 1) {
+        for (string_view data : sources)
+            parseLines(data, arena, table, batch, progress);
+        return;
+    }
+
+    // Cut the data into roughly equal chunks, moving each cut to just past the
+    // next line feed. The last chunk of each file is whatever is left of it.
+    size /= n;
+    for (string_view data : sources) {
+        while (!data.empty()) {
+            pos = data.find('\n', size);
+            pos = pos == string_view::npos ? data.size() : pos + 1;
+            chunks.push_back(make_unique<Chunk>(data.substr(0, pos), table->getLoadFactor()));
+            data.remove_prefix(pos);
+        }
+    }
+
+    auto work = [&chunks, &claimed, progress]() {
+        size_t next;
+
+        while ((next = claimed.fetch_add(1)) < chunks.size()) {
+            Chunk *c = chunks[next].get();
+            try {
+                parseLines(c->data, &c->arena, &c->table, c->courses, progress);
+            } catch (...) {
+                c->error = current_exception();
+            }
+        }
+    };
+    n = min<size_t>(n, chunks.size());
+    for (i = 1; i < n; i++)
+        workers.emplace_back(work);
+    work();
+    for (thread &worker : workers)
+        worker.join();
+
+    for (unique_ptr<Chunk> &chunk : chunks) {
+        if (chunk->error)
+            rethrow_exception(chunk->error);
+    }
+    for (unique_ptr<Chunk> &chunk : chunks) {
+        Prerequisite *items = chunk->table.getItems();
+
+        arena->adopt(chunk->arena);
+        for (i = 0; i < chunk->table.getCapacity(); i++) {
+            if (!items[i].empty())
+                table->insert(items[i].key);
+        }
+        batch.insert(batch.end(), chunk->courses.begin(), chunk->courses.end());
+    }
+}
+
+/**
+ * Loads the courses from the csv files without ever holding more of a file
+ * than one `STREAM_CHUNK_SIZE` buffer. The file is read a chunk at a time, and
+ * a line which runs past the end of a chunk is carried over to the start of
+ * the next. Each course is inserted into the index as soon as it is parsed.
+ *
+ * Prerequisites are resolved as they go rather than in a pass at the end. A
+ * prerequisite seen for the first time is searched for straight away; if its
+ * course has not appeared yet it goes into a pending set, which records that
+ * it has already been searched for, so that it is never searched for again.
+ * Entries are never removed from the pending set. When a course arrives
+ * which something may be waiting for, its entry in the prerequisites table is
+ * resolved with it, so by the end of the file every entry which can be resolved
+ * has been, with each distinct prerequisite searched for at most once.
+ *
+ * With a memory budget, the index and both tables are measured after every
+ * course. Once they outgrow the budget the courses so far are written out as a
+ * sorted run to a scratch file and everything is emptied, and from then on
+ * nothing is resolved as it goes, as the course it names may well be in a run
+ * which has already been written out. A run always holds at least a
+ * `STREAM_CHUNK_SIZE` of courses, so that a tiny budget does not turn every
+ * course into a run of its own. If anything was written out, the last run
+ * follows it at the end of the file and `spill` takes over.
+ *
+ * \param options the runtime configuration
+ * \return true if the catalog was spilled, in which case it has been loaded from
+ * the merged runs and fully validated
+ * \throws runtime_error if the file cannot be read or fails to parse, or a
+ * spilled catalog fails validation
+ */
+bool Catalog::stream(const Options &options) {
+    vector<char>      buffer(STREAM_CHUNK_SIZE);
+    vector<u_int32_t> commas;
+    PrereqHashTable   pending(DEFAULT_PREREQUISITE_TABLE_SIZE, options.loadFactor);
+    vector<Snapshot::Run> runs;
+    string            runsPath;
+    ofstream          runsOut;
+    Prerequisite     *entry;
+    string_view       data;
+    size_t            carried;
+    size_t            length;
+    size_t            used;
+    bool              last;
+    Clock::time_point start;
+    Clock::time_point step;
+
+    auto flush = [&]() {
+        step = Clock::now();
+        if (!runsOut.is_open()) {
+            runsPath = temporaryPath("ProjectTwo-runs-" + to_string(random_device()()));
+            runsOut.open(runsPath, ios::binary | ios::trunc);
+        }
+        runs.push_back(Snapshot::saveRun(runsOut, index));
+        if (!runsOut) {
+            runsOut.close();
+            remove(runsPath.c_str());
+            throw runtime_error("Unable to write " + runsPath);
+        }
+        index->drain();
+        prereqTable->clear();
+        pending.clear();
+        timings.spill += secondsSince(step);
+    };
+
+    for (const string &path : options.csvPaths) {
+        ifstream csv(path, ios::binary);
+
+        carried = 0;
+        if (!csv)
+            throw runtime_error("Unable to open " + path);
+        do {
+            start = Clock::now();
+            csv.read(buffer.data() + carried, buffer.size() - carried);
+            last = !csv;
+            data = string_view(buffer.data(), carried + csv.gcount());
+            timings.read += secondsSince(start);
+            if (last && csv.bad())
+                throw runtime_error("Unable to read " + path);
+
+            start = Clock::now();
+            while (!data.empty()) {
+                // Leave a line without its line feed for the next chunk, unless
+                // there is nothing more to come
+                length = CsvScanner::scanLine(data, commas);
+                if (length == data.size() && !last)
+                    break;
+
+                Course course;
+                course.init(data.substr(0, length), commas, prereqTable, index->getArena());
+                data.remove_prefix(min(length + 1, data.size()));
+                for (const CourseKey &key : course.prerequisites) {
+                    if (!runs.empty())
+                        break; // resolved once the runs are merged
+                    entry = prereqTable->find(key);
+                    if (entry->course == nullptr && pending.find(key) == nullptr) {
+                        entry->course = index->Search(key);
+                        if (entry->course == nullptr)
+                            pending.insert(key);
+                    }
+                }
+
+                CourseKey number = course.number;
+                if (options.statsPath.empty()) {
+                    index->Insert(std::move(course));
+                } else {
+                    step = Clock::now();
+                    index->Insert(std::move(course));
+                    timings.insert += secondsSince(step);
+                }
+                size++;
+                // Resolve anything which was waiting for this course. Where a
+                // number is duplicated the first course wins.
+                entry = prereqTable->find(number);
+                if (runs.empty() && entry != nullptr && entry->course == nullptr)
+                    entry->course = index->Search(number);
+                if (options.memoryBudget > 0) {
+                    used = index->getMemoryUsed();
+                    if (used >= STREAM_CHUNK_SIZE && used + (prereqTable->getCapacity()
+                            + pending.getCapacity()) * sizeof(Prerequisite) > options.memoryBudget)
+                        flush();
+                }
+            }
+            timings.parse += secondsSince(start);
+            parsed.fetch_add(data.data() - buffer.data(), memory_order_relaxed);
+
+            // Move the partial line to the front, making room for it if it fills
+            // the whole buffer
+            carried = data.size();
+            memmove(buffer.data(), data.data(), carried);
+            if (carried == buffer.size())
+                buffer.resize(buffer.size() * 2);
+        } while (!last);
+    }
+    // Inserts and spills are timed on their own when the timings are being
+    // reported
+    timings.parse -= timings.insert + timings.spill;
+    if (runs.empty())
+        return false;
+    if (index->getMemoryUsed() > 0)
+        flush();
+    runsOut.close();
+    spill(options, runsPath, runs);
+    return true;
+}
+
+/**
+ * Finishes loading a catalog which outgrew the memory budget while it was
+ * streamed. The runs are merged into a snapshot on disk, which also checks
+ * every prerequisite, and the catalog is loaded from that, with its titles and
+ * prerequisite lists used from the mapping. Its index is first set to map its
+ * own memory from scratch files, so the nodes and links are not held on the
+ * heap either. No more than one course per run is in memory at any point of the
+ * merge, and the full catalog is never held on the heap.
+ *
+ * The snapshot is merged beside the configured snapshot, if there is one, and
+ * only replaces it once the catalog has been checked for cycles; otherwise it
+ * is a scratch file, which is unlinked as soon as it is mapped.
+ *
+ * \param options the runtime configuration
+ * \param runsPath the run file, which is removed
+ * \param runs where each run starts in the run file
+ * \throws runtime_error if the runs cannot be merged, or the catalog fails
+ * validation
+ */
+void Catalog::spill(const Options &options, const string &runsPath,
+        const vector<Snapshot::Run> &runs) {
+    Clock::time_point start = Clock::now();
+    string            path = options.snapshotPath.empty()
+        ? temporaryPath("ProjectTwo-spill-" + to_string(random_device()()) + ".snap")
+        : options.snapshotPath + ".spill";
+    bool              linked;
+
+    stage.store("building", memory_order_relaxed);
+    try {
+        linked = Snapshot::merge(runsPath, runs, path, source);
+    } catch (...) {
+        remove(runsPath.c_str());
+        throw;
+    }
+    remove(runsPath.c_str());
+    if (!linked)
+        throw runtime_error("Prerequisite course check failed");
+
+    index->mapArena(temporaryPath("ProjectTwo-arena-" + to_string(random_device()())));
+    size = Snapshot::load(path, index, source);
+    if (size == 0) {
+        remove(path.c_str());
+        throw runtime_error("Unable to read " + path);
+    }
+    delete prereqTable;
+    prereqTable = new PrereqHashTable(options.tableSize, options.loadFactor);
+    timings.spill += secondsSince(start);
+
+    start = Clock::now();
+    stage.store("validating", memory_order_relaxed);
+    if (orderCourses() > 0) {
+        remove(path.c_str());
+        throw runtime_error("Prerequisite cycle check failed");
+    }
+    timings.validate = secondsSince(start);
+    if (options.snapshotPath.empty()) {
+        remove(path.c_str());
+    } else if (rename(path.c_str(), options.snapshotPath.c_str()) != 0) {
+        // The catalog is still perfectly usable from the mapping
+        cerr << "Unable to write snapshot " << options.snapshotPath << endl;
+        remove(path.c_str());
+    }
+}
+
+/**
+ * Load the course information from the csv files, or from the snapshot when
+ * there is a fresh one
+ * \param options the runtime configuration
+ * \throws runtime_error if the file cannot be read or fails validation
+ */
+void Catalog::load(const Options &options) {
+    vector<unique_ptr<MappedFile>> files;
+    vector<string_view> views;
+    vector<Course>    batch; // only used in bulk mode
+    vector<u_int32_t> commas; // only used in insert mode
+    Clock::time_point start = Clock::now();
+    Clock::time_point step;
+
+    timings = LoadTimings();
+    timings.source = "csv";
+    stage.store("reading", memory_order_relaxed);
+    // Take the details of the csv files before reading them, so that a change
+    // made while they are being read will be picked up by the next reload
+    Snapshot::statSource(options.csvPaths, source);
+    fileSize.store(source.st_size, memory_order_relaxed);
+    // A fresh snapshot saves having to parse and validate anything
+    if (!options.snapshotPath.empty()) {
+        size = Snapshot::load(options.snapshotPath, index, source);
+        if (size > 0) {
+            // A snapshot is only ever saved from a validated catalog
+            timings.source = "snapshot";
+            timings.read = secondsSince(start);
+            start = Clock::now();
+            stage.store("validating", memory_order_relaxed);
+            orderCourses();
+            timings.validate = secondsSince(start);
+            return;
+        }
+    }
+
+    size = 0;
+    if (options.loadMode == LoadStream && !index->isReadOnly()) {
+        timings.source = "stream";
+        timings.read = secondsSince(start);
+        stage.store("parsing", memory_order_relaxed);
+        // A spilled catalog has been validated as it was merged, and has
+        // already been saved to the snapshot
+        if (this->stream(options))
+            return;
+        start = Clock::now();
+        stage.store("validating", memory_order_relaxed);
+        // Every entry which can be resolved already has been
+        if (linkPrerequisites() == false)
+            throw runtime_error("Prerequisite course check failed");
+        if (orderCourses() > 0)
+            throw runtime_error("Prerequisite cycle check failed");
+        timings.validate = secondsSince(start);
+        saveSnapshot(options);
+        return;
+    }
+
+    // map the csv files into memory
+    mapSources(options.csvPaths, files, views);
+    timings.read = secondsSince(start);
+    start = Clock::now();
+    stage.store("parsing", memory_order_relaxed);
+    if (options.loadMode == LoadBulk || index->isReadOnly()) {
+        // Parse everything up front, then build the index in one pass
+        this->parse(views, options.threads, index->getArena(), prereqTable, batch, &parsed);
+        size = batch.size();
+    } else {
+        // Iterate over the lines in each file
+        for (string_view data : views) {
+            size_t unreported = data.size();
+
+            while (!data.empty()) {
+                /* Create and initialize a new Course using the next line and the
+                 * `Course::init` method */
+                Course      course;
+                string_view line = nextLine(data, commas);
+
+                course.init(line, commas, prereqTable, index->getArena());
+
+                // Add this course to the tree. Timing every insert costs a little,
+                // so it is only done when the timings are going to be reported.
+                if (options.statsPath.empty()) {
+                    index->Insert(std::move(course));
+                } else {
+                    step = Clock::now();
+                    index->Insert(std::move(course));
+                    timings.insert += secondsSince(step);
+                }
+                if (++size % PROGRESS_LINES == 0) {
+                    parsed.fetch_add(unreported - data.size(), memory_order_relaxed);
+                    unreported = data.size();
+                }
+            }
+            parsed.fetch_add(unreported, memory_order_relaxed);
+        }
+    }
+    // Make sure to close resources after use. This is only safe because every
+    // title has already been copied out of the mappings into the tree's arena.
+    files.clear();
+    timings.parse = secondsSince(start) - timings.insert;
+    start = Clock::now();
+    stage.store("building", memory_order_relaxed);
+    if (options.loadMode == LoadBulk || index->isReadOnly())
+        index->Build(batch);
+    timings.insert += secondsSince(start);
+    start = Clock::now();
+    stage.store("validating", memory_order_relaxed);
+    if (resolvePrerequisites() == false)
+        throw runtime_error("Prerequisite course check failed");
+    if (orderCourses() > 0)
+        throw runtime_error("Prerequisite cycle check failed");
+    timings.validate = secondsSince(start);
+    saveSnapshot(options);
+}
+
+/**
+ * Saves the catalog to the snapshot, when one has been configured. Only a
+ * validated catalog is worth saving. A failure here is not fatal as the
+ * catalog itself loaded fine, it just means the next start is slower.
+ * \param options the runtime configuration
+ */
+void Catalog::saveSnapshot(const Options &options) const {
+    if (!options.snapshotPath.empty()) {
+        try {
+            Snapshot::save(options.snapshotPath, index, source);
+        } catch (runtime_error &e) {
+            cerr << e.what() << endl;
+        }
+    }
+}
+
+/**
+ * Loads the current version of the csv files, using `previous` to avoid
+ * repeating work for anything which has not changed. The file still has to be
+ * parsed in full to find out what changed, but then it is merged against the
+ * previous catalog in course number order, which sorts every course into
+ * added, updated, removed or unchanged in a single O(n) pass.
+ *
+ * This is only for an index which cannot be changed in place, which every
+ * other reload goes through `refresh` to do. The index's layout has to be
+ * built again, so every course is a new one and every edge has to point at
+ * the new courses, but only the affected edges are looked up. An unchanged
+ * course's prerequisites were all checked when `previous` was loaded, so its
+ * links are carried over from its previous version: each course it linked to
+ * is mapped by its id in `previous` to the course which replaces it, which is
+ * an array index rather than a search, and a course with no replacement has
+ * been removed. The edges of added and updated courses are checked in full,
+ * through the prerequisites table, and only the entries they name are ever
+ * searched for.
+ *
+ * The prerequisites table is built from scratch each time, so entries for
+ * courses which are no longer required anywhere do not pile up across reloads.
+ *
+ * \param previous the catalog which is being replaced
+ * \param options the runtime configuration
+ * \return how the catalog changed
+ * \throws runtime_error if the file cannot be read or fails validation
+ */
+CatalogChanges Catalog::reload(const Catalog &previous, const Options &options) {
+    vector<unique_ptr<MappedFile>> files;
+    vector<string_view>   views;
+    vector<Course>        batch;
+    vector<const Course*> old;
+    vector<const Course*> previousOf; // By position, the previous version of each course,
+                                      // or NULL for an added or updated course
+    vector<const Course*> replacement; // By id in `previous`, the course replacing it,
+                                      // or NULL once it has been removed
+    CatalogChanges        changes;
+    Prerequisite         *entry;
+    u_int64_t             missing;
+    size_t                i;
+    size_t                j;
+    Clock::time_point     start = Clock::now();
+
+    timings = LoadTimings();
+    timings.source = "reload";
+    stage.store("reading", memory_order_relaxed);
+    Snapshot::statSource(options.csvPaths, source);
+    mapSources(options.csvPaths, files, views);
+    fileSize.store(source.st_size, memory_order_relaxed);
+    timings.read = secondsSince(start);
+    start = Clock::now();
+    stage.store("parsing", memory_order_relaxed);
+    // A reload always collects the courses, as it needs them all to compare
+    this->parse(views, options.threads, index->getArena(), prereqTable, batch, &parsed);
+    files.clear();
+    size = batch.size();
+    timings.parse = secondsSince(start);
+    start = Clock::now();
+    stage.store("building", memory_order_relaxed);
+
+    // Put the new courses into the same order as the previous index. This is
+    // the same stable sort as `Build`, which then has nothing left to do.
+    auto byNumber = [](const Course &a, const Course &b) {
+        return a.number < b.number;
+    };
+    if (!is_sorted(batch.begin(), batch.end(), byNumber))
+        stable_sort(batch.begin(), batch.end(), byNumber);
+    old.reserve(previous.size);
+    previous.index->ForEach([&](const Course &course) {
+        old.push_back(&course);
+    });
+
+    // Merge the two sorted lists, classifying every course
+    previousOf.resize(batch.size(), nullptr);
+    for (i = 0, j = 0; i < batch.size() || j < old.size();) {
+        if (j == old.size() || (i < batch.size() && batch[i].number < old[j]->number)) {
+            changes.added++;
+            i++;
+        } else if (i == batch.size() || old[j]->number < batch[i].number) {
+            changes.removed++;
+            j++;
+        } else {
+            if (batch[i].equals(*old[j]))
+                previousOf[i] = old[j];
+            else
+                changes.updated++;
+            i++;
+            j++;
+        }
+    }
+    index->Build(batch);
+    timings.insert = secondsSince(start);
+    start = Clock::now();
+    stage.store("validating", memory_order_relaxed);
+
+    // Map every course which is still in the catalog to its new version. The
+    // index visits the courses in the same order as the merge.
+    replacement.assign(previous.size, nullptr);
+    j = 0;
+    index->ForEach([&](const Course &course) {
+        while (j < old.size() && old[j]->number < course.number)
+            j++;
+        if (j < old.size() && old[j]->number == course.number)
+            replacement[old[j++]->id] = &course;
+    });
+
+    // Link every edge. An unchanged course's edges are carried over from its
+    // previous version, the rest are looked up.
+    i = 0;
+    missing = 0;
+    index->ForEach([&](const Course &course) {
+        for (u_int32_t k = 0; k < course.prerequisites.size; k++) {
+            const CourseKey &key = course.prerequisites[k];
+
+            if (previousOf[i] != nullptr) {
+                course.prerequisiteLinks[k] =
+                    replacement[previousOf[i]->prerequisiteLinks[k]->id];
+                if (course.prerequisiteLinks[k] == nullptr) {
+                    cerr << "Prerequisite course " << key << " of " << course.number
+                         << " has been removed" << endl;
+                    missing++;
+                }
+                continue;
+            }
+            // Where a number is duplicated the first course wins
+            entry = prereqTable->find(key);
+            if (entry != nullptr && entry->course == nullptr)
+                entry->course = index->Search(key);
+            course.prerequisiteLinks[k] = entry == nullptr ? nullptr : entry->course;
+            if (course.prerequisiteLinks[k] == nullptr) {
+                cerr << "Prerequisite course " << key << " of " << course.number
+                     << " does not exist" << endl;
+                missing++;
+            }
+        }
+        i++;
+    });
+    if (missing > 0)
+        throw runtime_error("Prerequisite course check failed");
+    if (orderCourses() > 0)
+        throw runtime_error("Prerequisite cycle check failed");
+    timings.validate = secondsSince(start);
+
+    saveSnapshot(options);
+    return changes;
+}
+
+/**
+ * Applies the changes in the csv files to this catalog in place, using the
+ * index's `Remove`, `Update` and `Insert`. The file is parsed into a scratch
+ * arena and diffed against the index just like `reload`, but then only the
+ * changed courses are copied into the catalog, so the cost beyond parsing is
+ * proportional to the number of changes rather than the size of the catalog.
+ *
+ * Everything is validated before anything is changed, so a reload which fails
+ * leaves the catalog exactly as it was. Removed courses are checked against the
+ * prerequisites of the new file, and the edges of added and updated courses are
+ * checked against the index as it will be once the changes have been applied.
+ * Because the index never moves a course, every link to a course which was not
+ * removed stays valid, and only the changed courses' own links are resolved.
+ *
+ * Up to that point the catalog is only read, so other threads may go on
+ * reading it too. The changes themselves are applied while holding `changing`
+ * exclusively, which waits for every reader which has pinned the catalog.
+ * Readers can only reach the catalog through a `Pinned` handle, and the only
+ * handle which holds no lock comes from `freeze`, which rules out any refresh
+ * from then on, so there is no reader for this to race with.
+ *
+ * \param options the runtime configuration
+ * \return how the catalog changed
+ * \throws runtime_error if the file cannot be read or fails validation
+ * \throws logic_error if the catalog has been frozen
+ */
+CatalogChanges Catalog::refresh(const Options &options) {
+    vector<unique_ptr<MappedFile>> files;
+    vector<string_view>         views;
+    struct stat                 csv;
+    Arena                       scratch;
+    unique_ptr<PrereqHashTable> required;
+    vector<Course>              batch;
+    vector<const Course*>       old;
+    vector<size_t>              changed; // positions in `batch` of added and updated courses
+    vector<CourseKey>           gone;
+    PrereqHashTable             removed(DEFAULT_PREREQUISITE_TABLE_SIZE, options.loadFactor);
+    PrereqHashTable             changedKeys(DEFAULT_PREREQUISITE_TABLE_SIZE, options.loadFactor);
+    CatalogChanges              changes;
+    Prerequisite               *items;
+    Prerequisite               *previous;
+    u_int64_t                   missing;
+    size_t                      i;
+    size_t                      j;
+    LoadTimings                 times;
+
+    if (frozen.load(memory_order_acquire))
+        throw logic_error("A frozen catalog cannot be refreshed");
+    Clock::time_point           start = Clock::now();
+
+    times.source = "refresh";
+    stage.store("reading", memory_order_relaxed);
+    Snapshot::statSource(options.csvPaths, csv);
+    mapSources(options.csvPaths, files, views);
+    fileSize.store(csv.st_size, memory_order_relaxed);
+    parsed.store(0, memory_order_relaxed);
+    times.read = secondsSince(start);
+    start = Clock::now();
+    stage.store("parsing", memory_order_relaxed);
+    // Collect the prerequisites of the new file in a table of their own, which
+    // will replace the current one and so drop any which are no longer needed
+    required = make_unique<PrereqHashTable>(options.tableSize, options.loadFactor);
+    this->parse(views, options.threads, &scratch, required.get(), batch, &parsed);
+    files.clear();
+    times.parse = secondsSince(start);
+    start = Clock::now();
+    stage.store("validating", memory_order_relaxed);
+
+    auto byNumber = [](const Course &a, const Course &b) {
+        return a.number < b.number;
+    };
+    if (!is_sorted(batch.begin(), batch.end(), byNumber))
+        stable_sort(batch.begin(), batch.end(), byNumber);
+    old.reserve(size);
+    index->ForEach([&](const Course &course) {
+        old.push_back(&course);
+    });
+
+    // Merge the two sorted lists, classifying every course
+    for (i = 0, j = 0; i < batch.size() || j < old.size();) {
+        if (j == old.size() || (i < batch.size() && batch[i].number < old[j]->number)) {
+            changed.push_back(i);
+            changes.added++;
+            i++;
+        } else if (i == batch.size() || old[j]->number < batch[i].number) {
+            gone.push_back(old[j]->number);
+            removed.insert(old[j]->number);
+            changes.removed++;
+            j++;
+        } else {
+            if (!batch[i].equals(*old[j])) {
+                changed.push_back(i);
+                changes.updated++;
+            }
+            i++;
+            j++;
+        }
+    }
+
+    // Remember where the new version of every changed course is
+    for (i = 0; i < changed.size(); i++) {
+        changedKeys.insert(batch[changed[i]].number);
+        changedKeys.find(batch[changed[i]].number)->course = &batch[changed[i]];
+    }
+
+    // Check everything before changing anything. A removed course which is
+    // still required is rare enough that finding who requires it can afford a
+    // scan of the new courses.
+    missing = 0;
+    for (const CourseKey &key : gone) {
+        if (required->find(key) == nullptr)
+            continue;
+        for (const Course &course : batch) {
+            for (const CourseKey &prerequisite : course.prerequisites) {
+                if (prerequisite == key) {
+                    cerr << "Prerequisite course " << key << " of " << course.number
+                         << " has been removed" << endl;
+                    missing++;
+                }
+            }
+        }
+    }
+    for (i = 0; i < changed.size(); i++) {
+        for (const CourseKey &key : batch[changed[i]].prerequisites) {
+            // Removed courses have already been reported
+            if (changedKeys.find(key) != nullptr || removed.find(key) != nullptr || index->Exists(key))
+                continue;
+            cerr << "Prerequisite course " << key << " of " << batch[changed[i]].number
+                 << " does not exist" << endl;
+            missing++;
+        }
+    }
+    if (missing > 0)
+        throw runtime_error("Prerequisite course check failed");
+    if (findNewCycles(changed, batch, changedKeys) > 0)
+        throw runtime_error("Prerequisite cycle check failed");
+    times.validate = secondsSince(start);
+    start = Clock::now();
+    stage.store("building", memory_order_relaxed);
+
+    // Apply the changes. Only the changed courses are copied out of the scratch
+    // arena, everything else in it is thrown away.
+    unique_lock<shared_mutex> exclusive(changing);
+    // Checked again now that nothing can be reading, in case it was frozen
+    // while the changes were being validated
+    if (frozen.load(memory_order_acquire))
+        throw logic_error("A frozen catalog cannot be refreshed");
+    for (const CourseKey &key : gone)
+        index->Remove(key);
+    for (i = 0; i < changed.size(); i++) {
+        Course &course = batch[changed[i]];
+
+        course.relocate(index->getArena());
+        if (!index->Update(std::move(course)))
+            index->Insert(std::move(course));
+    }
+    for (i = 0; i < changed.size(); i++) {
+        const Course *course = index->Search(batch[changed[i]].number);
+
+        for (j = 0; j < course->prerequisites.size; j++)
+            course->prerequisiteLinks[j] = index->Search(course->prerequisites[j]);
+    }
+
+    // Swap in the new prerequisites table, carrying every resolution over from
+    // the old one so that only new prerequisites need a search
+    items = required->getItems();
+    for (i = 0; i < required->getCapacity(); i++) {
+        if (items[i].empty())
+            continue;
+        previous = prereqTable->find(items[i].key);
+        items[i].course = previous != nullptr && previous->course != nullptr ?
+            previous->course : index->Search(items[i].key);
+    }
+    delete prereqTable;
+    prereqTable = required.release();
+
+    size = size + changes.added - changes.removed;
+    source = csv;
+    // The changes were checked for cycles, this only renumbers the courses
+    orderCourses();
+    exclusive.unlock();
+    times.insert = secondsSince(start);
+    // Only a refresh which went through replaces the last load's timings
+    timings = times;
+    saveSnapshot(options);
+    return changes;
+}
+
+/**
+ * Checks the catalog as it would be after a refresh for prerequisite cycles,
+ * without changing anything. The catalog had no cycles before, so any new
+ * cycle has to pass through a changed course, and it is enough to search from
+ * each of those. The search is the same as in `orderCourses`, except that it
+ * goes by course number, so that a changed course is always found in its new
+ * version.
+ *
+ * \param changed the positions in `batch` of the added and updated courses
+ * \param batch the courses from the new csv file
+ * \param changedKeys where to find each changed course in `batch`
+ * \return the number of cycles found
+ */
+size_t Catalog::findNewCycles(const vector<size_t> &changed, const vector<Course> &batch,
+        PrereqHashTable &changedKeys) {
+    PrereqHashTable entered(DEFAULT_PREREQUISITE_TABLE_SIZE, prereqTable->getLoadFactor());
+    PrereqHashTable finished(DEFAULT_PREREQUISITE_TABLE_SIZE, prereqTable->getLoadFactor());
+    Path            path;
+    size_t          cycles;
+
+    // The new version of a course, if it has changed, otherwise the current one
+    auto resolve = [&](CourseKey key) -> const Course * {
+        Prerequisite *entry = changedKeys.find(key);
+        return entry != nullptr ? entry->course : index->Search(key);
+    };
+
+    cycles = 0;
+    for (size_t i : changed) {
+        if (entered.find(batch[i].number) != nullptr)
+            continue;
+        entered.insert(batch[i].number);
+        path.emplace_back(&batch[i], 0);
+        while (!path.empty()) {
+            const Course *course = path.back().first;
+
+            if (path.back().second < course->prerequisites.size) {
+                const Course *target = resolve(course->prerequisites[path.back().second++]);
+                if (target == nullptr)
+                    continue;
+                if (entered.find(target->number) == nullptr) {
+                    entered.insert(target->number);
+                    path.emplace_back(target, 0);
+                } else if (finished.find(target->number) == nullptr) {
+                    reportCycle(path, target);
+                    cycles++;
+                }
+            } else {
+                finished.insert(course->number);
+                path.pop_back();
+            }
+        }
+    }
+    return cycles;
+}
+
+/**
+ * The orders the benchmark writes its synthetic catalogs in
+ */
+typedef enum {
+    OrderSorted      = 1, // ascending, the way the registrar exports the catalog
+    OrderRandom      = 2, // shuffled
+    OrderAdversarial = 3, // alternately the smallest and largest of what is left
+}   BenchOrder;
+
+/**
+ * Measures how long loading, validating, searching and listing take, against
+ * synthetic catalogs of 10^2 up to 10^`options.bench` courses in each key order,
+ * for every index engine and load mode. Each catalog is written to a temporary
+ * csv file and loaded through `Catalog::load`, exactly as the program loads the
+ * real one. Every phase is reported as a throughput and as the 50th, 90th and
+ * 99th percentile latencies: per lookup for `Search`, and per run for the rest.
+ *
+ * Inserting already sorted or zig-zagging keys one at a time into the plain BST
+ * degenerates it into a list and takes O(n^2), so those runs are skipped once
+ * the catalog is larger than `BENCH_DEGENERATE_LIMIT` courses.
+ */
+class Benchmark {
+    private:
+        /**
+         * A stream buffer which throws everything written to it away, so that
+         * listings can be timed without timing a terminal
+         */
+        struct NullBuffer : public streambuf {
+            int overflow(int c) override { return c; }
+            streamsize xsputn(const char *, streamsize n) override { return n; }
+        };
+
+        Options  options; // the runtime configuration, which runs are based on
+        string   csvPath; // where the synthetic catalogs are written
+        string   output;  // the results, rendered as they are measured
+
+        static const size_t DIGITS  = CourseKey::WIDTH > 3 ? 3 : CourseKey::WIDTH - 1; // Digits
+                                       // at the end of each course number
+        static const size_t LETTERS = CourseKey::WIDTH - DIGITS; // Letters naming the department
+
+        static size_t capacity();      // The number of distinct course numbers
+        static string key(size_t i);   // The course number of the i-th course
+        void   generate(size_t n, BenchOrder order) const; // Writes a synthetic catalog
+        void   report(const char *engine, const char *mode, const char *order, size_t n,
+                const char *phase, double rate, vector<double> &samples); // Renders a result
+        void   measure(const char *engine, IndexEngine index, const char *mode, LoadMode load,
+                const char *order, size_t n); // Measures every phase of one configuration
+
+    public:
+        Benchmark(const Options &options); // Constructor
+        int    run(ostream &out);          // Runs every configuration
+};
+
+/**
+ * Constructor
+ * \param options the runtime configuration, which gives the largest catalog
+ * and the parser threads to use
+ */
+Benchmark::Benchmark(const Options &options) {
+    this->options = options;
+    csvPath = temporaryPath("ProjectTwo-bench.csv");
+}
+
+/**
+ * Counts the course numbers `key` can make before they start to repeat
+ * \return the number of distinct course numbers, clamped to what a `size_t`
+ * can hold
  */
-void BinarySearchTree::drain() {
-    delete root;
-    root = nullptr;
+size_t Benchmark::capacity() {
+    size_t count = 1;
+    size_t c;
+
+    for (c = 0; c < DIGITS; c++)
+        count *= 10;
+    for (c = 0; c < LETTERS && count <= SIZE_MAX / 26; c++)
+        count *= 26;
+    return count;
 }
 
 /**
- * Begin the inOrder tree traversal, starting with the root node
+ * Builds the course number of the i-th course in key order, which is letters
+ * for a department and three digits, counting up from AAAA000 (with as many
+ * letters as the rest of `CourseKey::WIDTH` leaves room for). A width too
+ * narrow for that keeps at least one letter, and has fewer digits.
+ * \param i the position of the course, less than `capacity()`
+ * \return the course number
  */
-void BinarySearchTree::InOrder() {
-    this->inOrder(root);
+string Benchmark::key(size_t i) {
+    string number(CourseKey::WIDTH, '0');
+    size_t c;
+
+    for (c = DIGITS; c > 0; c--, i /= 10)
+        number[LETTERS + c - 1] = (char)('0' + i % 10);
+    for (c = LETTERS; c > 0; c--, i /= 26)
+        number[c - 1] = (char)('A' + i % 26);
+    return number;
 }
 
 /**
- * Insert a course into the BST
- * \param course the course to be inserted
+ * Writes a synthetic catalog of `n` courses to `csvPath`. Each course after
+ * the first few requires up to two of the courses shortly before it in key
+ * order, so the catalog is always free of cycles whatever order it is written
+ * in. The same `n` always gives the same catalog.
+ * \param n the number of courses
+ * \param order the order to write the courses in
+ * \throws runtime_error if the file cannot be written
  */
-void BinarySearchTree::Insert(Course course) {
-    if (this->root == nullptr) {
-        // Empty tree, make this the root
-        this->root = new Node(course);
-    } else {
-        // Traverse the tree to find the correct spot to insert this course
-        this->addNode(this->root, course);
+void Benchmark::generate(size_t n, BenchOrder order) const {
+    const size_t   WINDOW = 1000; // how far back prerequisites are chosen from
+    mt19937_64     random(n);
+    vector<size_t> positions(n);
+    string         buffer;
+    size_t         i;
+    ofstream       csv(csvPath, ios::binary | ios::trunc);
+
+    if (!csv)
+        throw runtime_error("Unable to write " + csvPath);
+    for (i = 0; i < n; i++)
+        positions[i] = i;
+    if (order == OrderRandom) {
+        shuffle(positions.begin(), positions.end(), random);
+    } else if (order == OrderAdversarial) {
+        for (i = 0; i < n; i++)
+            positions[i] = i % 2 == 0 ? i / 2 : n - 1 - i / 2;
+    }
+
+    for (size_t position : positions) {
+        mt19937_64 prerequisites(position);
+        size_t     window = min(position, WINDOW);
+
+        buffer += key(position);
+        buffer += ",Course number ";
+        buffer += to_string(position);
+        for (i = 0; window > 0 && i < position % 3; i++) {
+            buffer += ',';
+            buffer += key(position - 1 - prerequisites() % window);
+        }
+        buffer += '\n';
+        if (buffer.size() >= CourseIndex::OUTPUT_BUFFER_SIZE) {
+            csv.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
     }
+    csv.write(buffer.data(), buffer.size());
+    if (!csv.flush())
+        throw runtime_error("Unable to write " + csvPath);
 }
 
 /**
- * Searches the BST for a course with a matching ID number
- * \param courseNumber the course id number to look for
+ * Renders one result as a row of the results table
+ * \param engine the name of the index engine
+ * \param mode the name of the load mode
+ * \param order the name of the key order
+ * \param n the number of courses
+ * \param phase what was measured
+ * \param rate the throughput, in operations per second
+ * \param samples the latency of each operation in nanoseconds, which is sorted
  */
-Course BinarySearchTree::Search(string courseNumber) {
-    Node *currentNode = this->root;
+void Benchmark::report(const char *engine, const char *mode, const char *order, size_t n,
+        const char *phase, double rate, vector<double> &samples) {
+    char   row[160];
+    double p[3];
+    double rank[3] = { 0.50, 0.90, 0.99 };
+    int    i;
 
-    // If currentNode is null, then we have traversed the entire tree without
-    // finding a match. Loop until then.
-    while (currentNode != nullptr) {
-        if (currentNode->course.number == courseNumber) {
-            // match found
-            return currentNode->course;
-        } else {
-            // current node is not a match. If courseNumber is less, go left, if
-            // greater go right
-            currentNode = (courseNumber < currentNode->course.number) ? currentNode->left
-                : currentNode->right;
-        }
+    sort(samples.begin(), samples.end());
+    for (i = 0; i < 3; i++) {
+        size_t at = (size_t)ceil(rank[i] * samples.size());
+        p[i] = samples.empty() ? 0 : samples[at == 0 ? 0 : at - 1];
     }
-
-    // No match found, return an empty course
-    Course course;
-    return course;
+    snprintf(row, sizeof(row), "%-9s %-6s %-11s %9zu %-8s %14.0f %12.0f %12.0f %12.0f\n",
+            engine, mode, order, n, phase, rate, p[0], p[1], p[2]);
+    output += row;
 }
 
 /**
- * Check whether this course exists in the tree
- * \param courseNumber the course id number to validate
+ * Measures every phase of one configuration against the catalog in `csvPath`
+ * \param engine the name of the index engine
+ * \param index the index engine
+ * \param mode the name of the load mode
+ * \param load the load mode
+ * \param order the name of the key order the catalog was written in
+ * \param n the number of courses in the catalog
+ * \throws runtime_error if the catalog fails to load
  */
-bool BinarySearchTree::Exists(string courseNumber) {
-    // use the search function
-    Course course = this->Search(courseNumber);
-    // An empty course means nothing was found, while nonempty means we have
-    // a match
-    return !course.number.empty();
+void Benchmark::measure(const char *engine, IndexEngine index, const char *mode,
+        LoadMode load, const char *order, size_t n) {
+    const size_t          LOOKUPS = 100000; // searches timed per configuration
+    const size_t          BATCH = 256;      // courses each SearchMany looks up
+    const size_t          runs = max<size_t>(1, min<size_t>(20, 100000 / n));
+    Options               config = options;
+    unique_ptr<Catalog>   catalog;
+    vector<CourseKey>     keys;
+    vector<const Course*> results;
+    vector<double>        samples;
+    NullBuffer            discard;
+    ostream               out(&discard);
+    mt19937_64            random(n);
+    Clock::time_point     start;
+    double                total;
+    size_t                found;
+    size_t                i;
+
+    auto since = [](Clock::time_point start) {
+        return chrono::duration<double, nano>(Clock::now() - start).count();
+    };
+
+    config.csvPaths = { csvPath };
+    config.engine = index;
+    config.loadMode = load;
+    config.snapshotPath.clear();
+
+    // loadCourses, parsing the csv file through to a validated catalog
+    for (i = 0; i < runs; i++) {
+        catalog.reset();
+        catalog = make_unique<Catalog>(config);
+        start = Clock::now();
+        catalog->load(config);
+        samples.push_back(since(start));
+    }
+    total = accumulate(samples.begin(), samples.end(), 0.0);
+    report(engine, mode, order, n, "load", n * runs * 1e9 / total, samples);
+
+    // The prerequisite check on its own. Running it again over a loaded
+    // catalog does exactly the same work as the first time.
+    samples.clear();
+    for (i = 0; i < runs; i++) {
+        start = Clock::now();
+        if (!catalog->resolvePrerequisites())
+            throw runtime_error("Prerequisite course check failed");
+        samples.push_back(since(start));
+    }
+    total = accumulate(samples.begin(), samples.end(), 0.0);
+    report(engine, mode, order, n, "check", n * runs * 1e9 / total, samples);
+
+    /* Search, for courses which all exist. The throughput is taken from one
+     * untimed pass, as reading the clock around every lookup costs about as
+     * much as a lookup does. */
+    for (i = 0; i < LOOKUPS; i++)
+        keys.push_back(CourseKey(key(random() % n)));
+    found = 0;
+    start = Clock::now();
+    for (const CourseKey &number : keys)
+        found += catalog->Search(number) != nullptr;
+    total = since(start);
+    samples.clear();
+    for (const CourseKey &number : keys) {
+        start = Clock::now();
+        found += catalog->Search(number) != nullptr;
+        samples.push_back(since(start));
+    }
+    if (found != 2 * keys.size())
+        throw runtime_error("Benchmark lookup failed");
+    report(engine, mode, order, n, "search", keys.size() * 1e9 / total, samples);
+
+    // SearchMany, for the same courses a batch at a time. Each sample is the
+    // time per lookup within one batch.
+    results.resize(BATCH);
+    samples.clear();
+    total = 0;
+    found = 0;
+    for (i = 0; i < keys.size(); i += BATCH) {
+        size_t count = min(BATCH, keys.size() - i);
+
+        start = Clock::now();
+        catalog->SearchMany(keys.data() + i, count, results.data());
+        samples.push_back(since(start) / count);
+        total += samples.back() * count;
+        found += count - std::count(results.begin(), results.begin() + count, nullptr);
+    }
+    if (found != keys.size())
+        throw runtime_error("Benchmark lookup failed");
+    report(engine, mode, order, n, "many", keys.size() * 1e9 / total, samples);
+
+    // InOrder, rendering every course but writing it nowhere
+    samples.clear();
+    for (i = 0; i < runs; i++) {
+        start = Clock::now();
+        catalog->getIndex()->InOrder(out);
+        samples.push_back(since(start));
+    }
+    total = accumulate(samples.begin(), samples.end(), 0.0);
+    report(engine, mode, order, n, "inorder", n * runs * 1e9 / total, samples);
 }
 
 /**
- * An enum representing valid choices for user input to the main menu
+ * Runs every configuration, printing each catalog size's results as soon as
+ * they are measured
+ * \param out the stream to print the results to
+ * \return the exit status, 0 on success or 1 if anything failed
  */
-typedef enum {
-    LoadCourses    = 1,
-    DisplayCourses = 2,
-    FindCourse     = 3,
-    Exit           = 9,
-}   MenuChoice;
+int Benchmark::run(ostream &out) {
+    static const struct { const char *name; IndexEngine engine; } engines[] = {
+        { "bst", IndexBST }, { "avl", IndexAVL }, { "eytzinger", IndexEytzinger },
+    };
+    static const struct { const char *name; LoadMode mode; } modes[] = {
+        { "insert", LoadInsert }, { "bulk", LoadBulk },
+    };
+    static const struct { const char *name; BenchOrder order; } orders[] = {
+        { "sorted", OrderSorted }, { "random", OrderRandom }, { "adversarial", OrderAdversarial },
+    };
+    char   row[160];
+    size_t n;
+    int    e;
+
+    snprintf(row, sizeof(row), "%-9s %-6s %-11s %9s %-8s %14s %12s %12s %12s\n", "engine",
+            "load", "order", "courses", "phase", "ops/s", "p50 ns", "p90 ns", "p99 ns");
+    out << row << flush;
+    try {
+        for (n = 100, e = 2; e <= options.bench; n *= 10, e++) {
+            // A narrow course number runs out before the largest catalogs
+            if (n > capacity()) {
+                cerr << "Stopping before " << n << " courses, COURSE_KEY_WIDTH "
+                     << CourseKey::WIDTH << " only has room for " << capacity() << endl;
+                break;
+            }
+            for (const auto &order : orders) {
+                generate(n, order.order);
+                for (const auto &engine : engines) {
+                    for (const auto &mode : modes) {
+                        // A read-only index is always loaded in bulk
+                        if (engine.engine == IndexEytzinger && mode.mode == LoadInsert)
+                            continue;
+                        if (engine.engine == IndexBST && mode.mode == LoadInsert
+                                && order.order != OrderRandom && n > BENCH_DEGENERATE_LIMIT) {
+                            snprintf(row, sizeof(row), "%-9s %-6s %-11s %9zu skipped, the tree "
+                                    "degenerates into a list\n", engine.name, mode.name,
+                                    order.name, n);
+                            output += row;
+                            continue;
+                        }
+                        measure(engine.name, engine.engine, mode.name, mode.mode, order.name, n);
+                    }
+                }
+                out << output << flush;
+                output.clear();
+            }
+        }
+    } catch (runtime_error &e) {
+        cerr << e.what() << endl;
+        remove(csvPath.c_str());
+        return 1;
+    }
+    remove(csvPath.c_str());
+    return 0;
+}
 
 /**
  * The Driver class runs the main loop of the program
+ *
+ * The current catalog is held by a `shared_ptr` which is only ever read and
+ * written with the atomic `shared_ptr` operations. Every query starts by taking
+ * its own reference to the catalog which is current at that moment, and then
+ * pins it with `Catalog::pin` for as long as it reads from it. A reload of a
+ * mutable index, in the foreground or the background, applies the changes to
+ * that same catalog with `Catalog::refresh`, which waits for the pinned queries
+ * to finish before it changes anything. Only a read-only (Eytzinger) index has
+ * a complete new catalog built first, which is swapped in with one atomic
+ * step, so that a query running during the reload carries on, lock free, with
+ * the old catalog, which is freed once the last query holding it finishes.
+ * Batch mode's reader threads do not pin, so it only reloads before it starts
+ * querying, and freezes the catalog so that nothing can refresh it after that.
  */
 class Driver {
     private:
-        string csvPath; // the path to the csv file where course data is found
+        Options  options;  // the runtime configuration, including the csv path
         const char * menuText =
             "\n  /==============================\\\n"
             "  |  Menu                        |\n"
             "  |    1. Load Courses           |\n"
             "  |    2. Display Courses        |\n"
             "  |    3. Find Course by number  |\n"
+            "  |    4. List Courses by number |\n"
+            "  |    5. Plan a Schedule        |\n"
+            "  |    6. Find Dependent Courses |\n"
             "  |    9. Exit                   |\n"
             "  \\==============================/\n";
 
-        BinarySearchTree  tree;        // The BST where course information will be stored
+        shared_ptr<Catalog> catalog;  // The published catalog, only accessed atomically
+        shared_ptr<Catalog> building; // The catalog being loaded, if any, only accessed
+                                      // atomically
+        thread       loader;          // Loads the courses in the background
+        atomic<bool> loaderDone;      // Set once `loader` has finished, and filled in
+                                      // `loaderReport`
+        string       loaderReport;    // The outcome of the background load
+        bool         loaderFailed;    // Whether `loaderReport` is an error
 
-        PrereqHashTable  *prereqTable; // The hash table where prerequisites will be stored
-                                       // to validate that they match to actual courses
-
-        bool checkPrerequisites();     // Checks whether all of the prerequisite courses
-                                       // are valid or not
+        shared_ptr<const Catalog> acquire() const; // Takes a reference to the current catalog
+        void   publish(shared_ptr<Catalog> next); // Makes `next` the current catalog
+        size_t load();                 // Loads the courses, returning how many were loaded
+        CatalogChanges reload();       // Reloads the courses, reporting what changed
+        string loadOrReload();         // Loads or reloads the courses, describing the outcome
+        void   reportLoad(bool wait);  // Reports how the background load is getting on
+        void   writeStats(const Catalog &loaded) const; // Reports a load's stats, if enabled
 
     public:
         Driver();                   // Base constructor
         Driver(string csvPath);     // Constructor, with csvpath parameter
+        Driver(const Options &options); // Constructor, with runtime configuration
         virtual    ~Driver();       // Destructor
         MenuChoice  menu();         // Displays the menu and gets the user's selection
         void        loadCourses();  // Loads the courses from csvfile
         void        printCourses(); // Prints the courses in alphanumeric order
         void        search();       // Searches for a course by its ID number
+        void        listCourses();  // Lists the courses with a prefix or in a range
+        void        planSchedule(); // Plans the semesters needed to take some courses
+        void        findDependents(); // Finds the courses which depend on a course
         void        run();          // Run the main program loop
+        int         batch(istream &in, ostream &out); // Looks up every course number in `in`
 };
 
-/**
- * Validates that all prerequisites are valid courses
- */
-bool Driver::checkPrerequisites() {
-    int           i;
-    Prerequisite *prerequisites;
-
-    // Get the internal array of prerequisites from the hash table
-    prerequisites = this->prereqTable->getItems();
-
-    // loop over the array
-    for (i = 0; i < prereqTable->getCapacity(); i++) {
-        // Only check non-empty prerequisites
-        if (!prerequisites[i].empty()) {
-            // Copy the data to a string for comparison
-            string course = prerequisites[i].getString();
-            // If any course fails the check, bail and exit
-            if (!tree.Exists(course)) {
-                cerr << "Prerequisite course " << course << " does not exist";
-                return false;
-            }
-        }
-    }
-    // All prerequisites accounted for, return true
-    return true;
-}
-
 /**
  * Base constructor
  */
-Driver::Driver() {
-    prereqTable = new PrereqHashTable(DEFAULT_PREREQUISITE_TABLE_SIZE);
+Driver::Driver() : Driver(Options()) {
 }
 
 /**
@@ -603,15 +5978,42 @@ Driver::Driver() {
  * \param csvPath the path to the csv data file
  */
 Driver::Driver(string csvPath) : Driver() {
-    this->csvPath = csvPath;
+    this->options.csvPaths.assign(1, csvPath);
+}
+
+/**
+ * Constructor, with the full runtime configuration
+ * \param options the options given on the command line
+ */
+Driver::Driver(const Options &options) : loaderDone(false), loaderFailed(false) {
+    this->options = options;
+    // Start out with an empty catalog, so that there is always one to query
+    publish(make_shared<Catalog>(options));
 }
 
 /**
  * Destructor
  */
 Driver::~Driver() {
-    // Delete the hash table which we allocated on the stack
-    delete prereqTable;
+    if (loader.joinable())
+        loader.join();
+}
+
+/**
+ * Takes a reference to the current catalog. The catalog stays valid for as
+ * long as the reference is held, even if a reload publishes a new one.
+ * \return the current catalog
+ */
+shared_ptr<const Catalog> Driver::acquire() const {
+    return atomic_load(&catalog);
+}
+
+/**
+ * Publishes a new catalog, which every query from now on will see
+ * \param next the fully loaded catalog
+ */
+void Driver::publish(shared_ptr<Catalog> next) {
+    atomic_store(&catalog, std::move(next));
 }
 
 /**
@@ -647,6 +6049,9 @@ MenuChoice Driver::menu() {
             case LoadCourses:
             case DisplayCourses:
             case FindCourse:
+            case ListCourses:
+            case PlanSchedule:
+            case FindDependents:
             case Exit:
                 return (MenuChoice)c;
             default:
@@ -657,46 +6062,184 @@ MenuChoice Driver::menu() {
 }
 
 /**
- * Load the course information from the csv file
+ * Load the course information into a new catalog, and publish it once it has
+ * loaded and validated successfully. If the load fails the current catalog is
+ * left in place.
+ * \return the number of courses loaded
+ * \throws runtime_error if the file cannot be read or fails validation
+ */
+size_t Driver::load() {
+    shared_ptr<Catalog> next = make_shared<Catalog>(options);
+
+    atomic_store(&building, next);
+    next->load(options);
+    writeStats(*next);
+    publish(next);
+    return next->getSize();
+}
+
+/**
+ * Writes the stats of a load to `options.statsPath`, when it is set. Each load
+ * replaces the file, while on stderr there is one line per load.
+ * \param loaded the catalog which has just loaded
+ */
+void Driver::writeStats(const Catalog &loaded) const {
+    string stats;
+
+    if (options.statsPath.empty())
+        return;
+    loaded.renderStats(stats);
+    if (options.statsPath == "-") {
+        cerr << stats << flush;
+    } else {
+        ofstream out(options.statsPath, ios::trunc);
+        if (!(out << stats))
+            cerr << "Unable to write " << options.statsPath << endl;
+    }
+}
+
+/**
+ * Reload the course information, based on the current catalog. If the csv file
+ * has not changed since it was loaded the current catalog is kept as it is.
+ * Otherwise the changes are applied to it in place, which waits out any query
+ * the menu has pinned the catalog for, even when the reload is running in the
+ * background. Only an index which cannot be changed has a new catalog built on
+ * the side, which is published once it has loaded and validated successfully.
+ * \return how the catalog changed
+ * \throws runtime_error if the file cannot be read or fails validation
+ */
+CatalogChanges Driver::reload() {
+    shared_ptr<const Catalog> current = acquire();
+    shared_ptr<Catalog>       next;
+    CatalogChanges            changes;
+    struct stat               csv;
+
+    Snapshot::statSource(options.csvPaths, csv);
+    if (current->isLoadedFrom(csv))
+        return changes;
+
+    /* The menu pins the catalog for each query, so `refresh` never changes it
+     * underneath one. Batch mode freezes the catalog once it starts querying,
+     * after which `refresh` refuses to run. */
+    next = atomic_load(&catalog);
+    if (!next->isReadOnly()) {
+        atomic_store(&building, next);
+        changes = next->refresh(options);
+        writeStats(*next);
+        return changes;
+    }
+
+    next = make_shared<Catalog>(options);
+    atomic_store(&building, next);
+    changes = next->reload(*current, options);
+    writeStats(*next);
+    publish(next);
+    return changes;
+}
+
+/**
+ * Load the course information from the csv file, or once there is a catalog
+ * apply only what has changed
+ * \return a description of the outcome, for the user
+ * \throws runtime_error if the file cannot be read or fails validation
+ */
+string Driver::loadOrReload() {
+    string report;
+
+    try {
+        if (acquire()->getSize() == 0) {
+            report = "Loaded " + to_string(this->load()) + " courses";
+        } else {
+            CatalogChanges changes = this->reload();
+            report = "Reloaded " + to_string(acquire()->getSize()) + " courses: "
+                + to_string(changes.added) + " added, " + to_string(changes.updated)
+                + " updated, " + to_string(changes.removed) + " removed";
+        }
+    } catch (...) {
+        atomic_store(&building, shared_ptr<Catalog>());
+        throw;
+    }
+    atomic_store(&building, shared_ptr<Catalog>());
+    return report;
+}
+
+/**
+ * Load the course information from the csv file, reporting the outcome to the
+ * user. Once there is a catalog, loading again only applies what has changed.
+ *
+ * In the background the load runs on a worker thread, and the menu goes on
+ * querying the current catalog until the new one is published, or until a
+ * refresh applies its changes to it. The outcome is reported the next time the
+ * menu is shown. Only one load runs at a time.
  */
 void Driver::loadCourses() {
-    ifstream infs;
-    string   line;
-    int      num;
-
-    num = 0;
-    /* If this function is called a second time, then it is necessary to empty
-     * the tree out before refilling it */
-    tree.drain();
-
-    // open the csv file for reading
-    infs.open(csvPath);
-    // Iterate over the lines in the file
-    while (getline(infs, line)) {
-        /* Create and initialize a new Course using this line and the
-         * `Course::init` method */
-        Course course;
-        course.init(line, prereqTable);
+    if (!options.background) {
+        try {
+            cout << "\n" << loadOrReload() << endl;
+        } catch (runtime_error &e) {
+            cerr << "\n" << e.what() << endl;
+        }
+        return;
+    }
 
-        // Add this course to the tree
-        tree.Insert(course);
-        num++;
+    // Finish off a load which has just completed, the menu says how far one
+    // which is still running has got
+    if (loader.joinable() && !loaderDone.load(memory_order_acquire)) {
+        cout << "\nThe courses are already loading" << endl;
+        return;
     }
-    // Make sure to close resources after use
-    infs.close();
-    if (checkPrerequisites() == false)
-        throw runtime_error("Prerequisite course check failed");
-    cout << "\nLoaded " << num << " courses" << endl;
+    reportLoad(false);
+    loaderDone.store(false, memory_order_relaxed);
+    loader = thread([this]() {
+        try {
+            loaderReport = loadOrReload();
+            loaderFailed = false;
+        } catch (runtime_error &e) {
+            loaderReport = e.what();
+            loaderFailed = true;
+        }
+        loaderDone.store(true, memory_order_release);
+    });
+}
+
+/**
+ * Reports on the background load, if there is one: how far it has got while it
+ * runs, or its outcome once it has finished.
+ * \param wait true to wait for the load to finish and report its outcome
+ */
+void Driver::reportLoad(bool wait) {
+    if (!loader.joinable())
+        return;
+    if (!wait && !loaderDone.load(memory_order_acquire)) {
+        shared_ptr<const Catalog> next = atomic_load(&building);
+        LoadProgress              progress;
+
+        if (next != nullptr)
+            progress = next->getProgress();
+        cout << "\nLoading courses: " << progress.stage;
+        if (strcmp(progress.stage, "parsing") == 0 && progress.size > 0)
+            cout << ", " << progress.parsed * 100 / progress.size << "%";
+        cout << endl;
+        return;
+    }
+    loader.join();
+    if (loaderFailed)
+        cerr << "\n" << loaderReport << endl;
+    else
+        cout << "\n" << loaderReport << endl;
 }
 
 /**
  * Print the course schedule in alphanumeric order
  */
 void Driver::printCourses() {
+    shared_ptr<const Catalog> current = acquire();
+    Catalog::Pinned           pinned = current->pin();
+
     cout << "\n  Here is a sample schedule:\n" << endl;
     /* performs an inorder traversal of the BST, printing the basic course information
      * for each node as it is visited */
-    tree.InOrder();
+    pinned.getIndex()->InOrder(cout);
 }
 
 /**
@@ -704,30 +6247,214 @@ void Driver::printCourses() {
  * course details
  */
 void Driver::search() {
-    string courseNumber;
+    string              courseNumber;
+    string              details;
+    CourseKey           key;
+    Catalog::CourseList matches;
 
     cout << "What course do you want to know about? ";
 
     // Read the course number from stdin into a string
     getline(cin, courseNumber);
 
-    /* if the course number is empty or the size is not 7 characters, this is not
-     * a valid course ID number */
-    if (courseNumber.empty() || courseNumber.size() != 7) {
+    // There is nothing at all to search for
+    if (courseNumber.find_first_not_of(" \t\r") == string::npos) {
         cerr << "\nInvalid course number" << endl;
     } else {
-        // Do the search
-        Course course = this->tree.Search(courseNumber);
+        // Do the search. Holding `current` keeps the course alive while we use it.
+        // Going through the details cache means a course which is looked up
+        // again is neither searched for nor formatted a second time.
+        shared_ptr<const Catalog> current = acquire();
+        Catalog::Pinned           pinned = current->pin();
+        const Course *course = nullptr;
+
+        if (CourseKey::normalize(courseNumber, key))
+            course = pinned.renderDetails(key, details);
+
+        // Not a course number, so try it as (part of) a title instead
+        if (course == nullptr) {
+            pinned.SearchTitles(courseNumber, matches);
+            if (matches.size() == 1) {
+                course = matches[0];
+                course->renderDetails(details);
+            }
+        }
 
-        /* Uses the `Course.empty()` helper method to be sure the returned course
-         * is not empty */
-        if (course.empty()) {
+        // A NULL result means that there is no such course
+        if (course == nullptr && matches.empty()) {
             cout << "\nNo matching course found." << endl;
+        } else if (course == nullptr) {
+            string listing;
+
+            for (const Course *match : matches)
+                match->render(listing);
+            cout << "\nMatching courses:\n" << listing;
+        } else {
+            // Only worth listing again when there are indirect prerequisites
+            if (pinned.Closure(*course).size() > course->prerequisites.size)
+                pinned.renderClosure(*course, details);
+            cout << endl << details;
+        }
+    }
+}
+
+/**
+ * Looks up a list of course numbers separated by commas. Each one may be typed
+ * in any case and spacing, as `CourseKey::normalize` accepts, so "csci 200"
+ * is the single course CSCI200. A field which is not a course number as a
+ * whole is taken as several course numbers separated by whitespace instead.
+ * \param catalog the catalog to search
+ * \param line the course numbers
+ * \param targets filled in with the matching courses
+ * \param out where any course numbers which are not found are reported
+ * \return false if any of the course numbers were not found
+ */
+static bool findCourses(const Catalog::Pinned &catalog, string_view line, Catalog::CourseList &targets,
+        string &out) {
+    bool                  found = true;
+    vector<pair<string_view, bool>> courseNumbers; // As typed, and whether each is valid
+    vector<CourseKey>     keys;
+    vector<const Course*> courses;
+    CourseKey             key;
+    string_view           field;
+    size_t                comma;
+    size_t                start;
+    size_t                end;
+    size_t                i;
+
+    auto add = [&](string_view courseNumber) {
+        courseNumbers.emplace_back(courseNumber, CourseKey::normalize(courseNumber, key));
+        if (courseNumbers.back().second)
+            keys.push_back(key);
+    };
+    targets.clear();
+    for (comma = 0; comma <= line.size(); comma = end + 1) {
+        end = min(line.find(',', comma), line.size());
+        field = line.substr(comma, end - comma);
+        // A whole field which is a course number is one, spaces and all
+        if (CourseKey::normalize(field, key)) {
+            start = field.find_first_not_of(" \t\r");
+            add(field.substr(start, field.find_last_not_of(" \t\r") - start + 1));
+            continue;
+        }
+        for (start = field.find_first_not_of(" \t\r"); start != string_view::npos;
+                start = field.find_first_not_of(" \t\r", i)) {
+            i = min(field.find_first_of(" \t\r", start), field.size());
+            add(field.substr(start, i - start));
+        }
+    }
+    // Look every valid course number up in one go
+    courses.resize(keys.size());
+    catalog.SearchMany(keys.data(), keys.size(), courses.data());
+
+    i = 0;
+    for (const pair<string_view, bool> &entry : courseNumbers) {
+        string_view courseNumber = entry.first;
+
+        if (!entry.second) {
+            out += courseNumber;
+            out += ": Invalid course number\n";
+            found = false;
+        } else if (const Course *course = courses[i++]) {
+            targets.push_back(course);
         } else {
-            cout << endl;
-            course.displayDetails();
+            out += courseNumber;
+            out += ": No matching course found.\n";
+            found = false;
         }
     }
+    return found;
+}
+
+/**
+ * Plans the semesters needed to take a list of courses, taken from user input,
+ * along with everything they require. An empty list plans the whole catalog.
+ * There are at most `termCap` courses in each semester.
+ */
+void Driver::planSchedule() {
+    Catalog::CourseList       targets;
+    vector<Catalog::CourseList> terms;
+    string                    input;
+    string                    out;
+
+    cout << "Which courses do you want to plan for (blank for all of them)? ";
+    getline(cin, input);
+
+    // Only pinned once the input is in, so a refresh never waits on the user
+    shared_ptr<const Catalog> current = acquire();
+    Catalog::Pinned           pinned = current->pin();
+
+    if (!findCourses(pinned, input, targets, out)) {
+        cerr << "\n" << out;
+        return;
+    }
+    pinned.Plan(targets, options.termCap, terms);
+    if (terms.empty()) {
+        cout << "\nNothing to plan." << endl;
+        return;
+    }
+    Catalog::renderPlan(terms, out);
+    cout << endl << out;
+}
+
+/**
+ * Finds the courses which depend on a course, taken from user input, which are
+ * the courses affected if it were retired
+ */
+void Driver::findDependents() {
+    Catalog::CourseList       course;
+    string                    input;
+    string                    out;
+
+    cout << "Which course do you want to find the dependents of? ";
+    getline(cin, input);
+
+    shared_ptr<const Catalog> current = acquire();
+    Catalog::Pinned           pinned = current->pin();
+
+    if (!findCourses(pinned, input, course, out) || course.size() != 1) {
+        cerr << "\n" << (out.empty() ? "Invalid course number\n" : out);
+        return;
+    }
+    pinned.renderDependents(*course[0], out);
+    if (out.empty())
+        cout << "\nNo courses depend on " << course[0]->number << endl;
+    else
+        cout << endl << out;
+}
+
+/**
+ * Lists every course whose number starts with a prefix, such as "CSCI3" for
+ * all of the 300 level CSCI courses, or which falls in a range such as
+ * "CSCI300-CSCI350", taken from user input. The end of a range can itself be a
+ * prefix, so "CSCI3-CSCI4" includes every course up to and including CSCI499.
+ */
+void Driver::listCourses() {
+    string      input;
+    string_view lo;
+    string_view hi;
+    size_t      dash;
+    size_t      count;
+
+    cout << "Which courses do you want to list (a prefix such as CSCI3, or a range"
+            " such as CSCI300-CSCI350)? ";
+    getline(cin, input);
+
+    // A range is two prefixes with a dash between them, a single prefix is both
+    dash = input.find('-');
+    lo = string_view(input).substr(0, dash);
+    hi = dash == string::npos ? lo : string_view(input).substr(dash + 1);
+    if (lo.empty() || hi.empty() || lo.size() > CourseKey::WIDTH || hi.size() > CourseKey::WIDTH) {
+        cerr << "\nInvalid course prefix" << endl;
+        return;
+    }
+
+    shared_ptr<const Catalog> current = acquire();
+    Catalog::Pinned           pinned = current->pin();
+    cout << endl;
+    count = pinned.getIndex()->PrintRange(CourseKey(lo), CourseKey::upperBound(hi), cout);
+    if (count == 0)
+        cout << "No matching courses found." << endl;
 }
 
 void Driver::run() {
@@ -736,6 +6463,7 @@ void Driver::run() {
     cout << "Welcome to the course planner." << endl;
 
     do {
+        this->reportLoad(false);
         choice = this->menu();
         switch (choice) {
         case LoadCourses:
@@ -747,21 +6475,278 @@ void Driver::run() {
         case FindCourse:
             this->search();
             break;
+        case ListCourses:
+            this->listCourses();
+            break;
+        case PlanSchedule:
+            this->planSchedule();
+            break;
+        case FindDependents:
+            this->findDependents();
+            break;
         case Exit:
             break;
         }
     } while (choice != Exit);
 
+    if (loader.joinable() && !loaderDone.load(memory_order_acquire))
+        cout << "\nWaiting for the courses to finish loading" << endl;
+    this->reportLoad(true);
+
     cout << "\nThank you for using the course planner!\n" << endl;
 }
 
-int main(int argc, char *argv[]) {
-    Driver *driver;
-    string  csvPath;
+/**
+ * Parses the name of an index engine, as given on the command line
+ * \param name the name of the engine
+ * \return the matching `IndexEngine`
+ */
+IndexEngine parseEngine(string name) {
+    if (name == "bst")
+        return IndexBST;
+    else if (name == "avl")
+        return IndexAVL;
+    else if (name == "eytzinger")
+        return IndexEytzinger;
+    throw invalid_argument("Unknown index engine " + name);
+}
+
+/**
+ * Parses the name of a load mode, as given on the command line
+ * \param name the name of the mode
+ * \return the matching `LoadMode`
+ */
+LoadMode parseLoadMode(string name) {
+    if (name == "insert")
+        return LoadInsert;
+    else if (name == "bulk")
+        return LoadBulk;
+    else if (name == "stream")
+        return LoadStream;
+    throw invalid_argument("Unknown load mode " + name);
+}
+
+/**
+ * Parses a size in bytes, as given on the command line, which may end in K, M
+ * or G for kibibytes, mebibytes or gibibytes
+ * \param text the size
+ * \return the number of bytes
+ * \throws invalid_argument if `text` is not a size
+ */
+u_int64_t parseSize(string text) {
+    size_t    end;
+    u_int64_t bytes = stoull(text, &end);
+    string    unit = text.substr(end);
+
+    if (unit == "K" || unit == "k")
+        return bytes << 10;
+    else if (unit == "M" || unit == "m")
+        return bytes << 20;
+    else if (unit == "G" || unit == "g")
+        return bytes << 30;
+    else if (!unit.empty())
+        throw invalid_argument("Unknown size " + text);
+    return bytes;
+}
+
+/**
+ * Looks up a single batch query and renders the result
+ * \param catalog the catalog to search
+ * \param query one line of input, which should be a course number in any case
+ * and spacing, or a comma separated list of course numbers to plan for in plan
+ * mode
+ * \param options the runtime configuration, which says what to render
+ * \param out where the result is rendered
+ */
+static void renderQuery(const Catalog::Pinned &catalog, string_view query, const Options &options,
+        string &out) {
+    // Ignore surrounding whitespace, including a stray carriage return
+    size_t    first = query.find_first_not_of(" \t\r");
+    size_t    last = query.find_last_not_of(" \t\r");
+    CourseKey key;
+    if (first == string_view::npos)
+        return;
+    string_view courseNumber = query.substr(first, last - first + 1);
 
-    if (argc > 1) {
-        csvPath = argv[1];
+    if (options.plan) {
+        Catalog::CourseList         targets;
+        vector<Catalog::CourseList> terms;
+
+        if (findCourses(catalog, courseNumber, targets, out)) {
+            catalog.Plan(targets, options.termCap, terms);
+            out += "Plan for ";
+            out += courseNumber;
+            out += ":\n";
+            Catalog::renderPlan(terms, out);
+        }
+    } else if (!CourseKey::normalize(courseNumber, key)) {
+        out += courseNumber;
+        out += ": Invalid course number\n";
     } else {
+        const Course *course = catalog.renderDetails(key, out);
+        if (course == nullptr) {
+            out += courseNumber;
+            out += ": No matching course found.\n";
+        } else {
+            if (options.closure)
+                catalog.renderClosure(*course, out);
+            if (options.dependents)
+                catalog.renderDependents(*course, out);
+        }
+    }
+}
+
+/**
+ * Runs without the menu. The courses are loaded once, and then each line of
+ * `in` is taken as a course number to look up. The details of every course are
+ * rendered into a buffer which is written out in large chunks, so thousands of
+ * lookups cost a handful of writes rather than a prompt and a flush apiece.
+ *
+ * Queries are read in blocks. When more than one thread is available each
+ * block is split between several reader threads which all search the same
+ * catalog at once, each rendering into its own buffer, and the buffers are
+ * written out in their original order.
+ *
+ * \param in the stream of course numbers, one per line
+ * \param out the stream where the course details are written
+ * \return the program's exit status
+ */
+int Driver::batch(istream &in, ostream &out) {
+    const size_t   BLOCK_SIZE = 16 * 1024; // queries read at a time
+    const size_t   MIN_SLICE = 1024;       // fewest queries worth a thread
+    vector<string> queries;
+    vector<string> buffers;
+    vector<thread> workers;
+    string         line;
+    size_t         n;
+    size_t         t;
+
+    // Keep stdout clean for the results, the summary goes to stderr
+    try {
+        cerr << loadOrReload() << endl;
+    } catch (runtime_error &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    // The reader threads share one handle rather than pinning for every query,
+    // so the catalog is frozen against any refresh from here on
+    shared_ptr<const Catalog> current = acquire();
+    Catalog::Pinned           reader = current->freeze();
+    n = options.threads == 0 ? thread::hardware_concurrency() : options.threads;
+    n = max<size_t>(n, 1);
+    buffers.resize(n);
+
+    while (in) {
+        // Read the next block of queries
+        queries.clear();
+        while (queries.size() < BLOCK_SIZE && getline(in, line))
+            queries.push_back(line);
+
+        // Split the block into slices of at least MIN_SLICE queries
+        size_t threads = min(n, queries.size() / MIN_SLICE + 1);
+        size_t slice = (queries.size() + threads - 1) / threads;
+        auto render = [&](size_t t) {
+            size_t end = min(queries.size(), (t + 1) * slice);
+            buffers[t].clear();
+            for (size_t i = t * slice; i < end; i++)
+                renderQuery(reader, queries[i], options, buffers[t]);
+        };
+
+        workers.clear();
+        for (t = 1; t < threads; t++)
+            workers.emplace_back(render, t);
+        render(0);
+        for (thread &worker : workers)
+            worker.join();
+
+        for (t = 0; t < threads; t++)
+            out.write(buffers[t].data(), buffers[t].size());
+    }
+    out.flush();
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    Driver  *driver;
+    Options  options;
+    string   csvPath;
+    int      i;
+    int      status;
+
+    // We never mix C stdio with the C++ streams, so let cout do its own buffering
+    ios::sync_with_stdio(false);
+
+    // Only an interactive session needs to keep the menu going during a load
+    options.background = isatty(fileno(stdin));
+
+    // Options begin with `--`, anything else is taken to be a csv path
+    for (i = 1; i < argc; i++) {
+        string arg = argv[i];
+        try {
+            if (arg.rfind("--index=", 0) == 0) {
+                options.engine = parseEngine(arg.substr(8));
+            } else if (arg.rfind("--load=", 0) == 0) {
+                options.loadMode = parseLoadMode(arg.substr(7));
+            } else if (arg.rfind("--table-size=", 0) == 0) {
+                options.tableSize = stoull(arg.substr(13));
+                if (options.tableSize > MAX_PREREQUISITE_TABLE_SIZE)
+                    throw out_of_range(arg);
+            } else if (arg.rfind("--load-factor=", 0) == 0) {
+                options.loadFactor = stod(arg.substr(14));
+            } else if (arg.rfind("--snapshot=", 0) == 0) {
+                options.snapshotPath = arg.substr(11);
+            } else if (arg.rfind("--threads=", 0) == 0) {
+                options.threads = stoul(arg.substr(10));
+            } else if (arg == "--closure") {
+                options.closure = true;
+            } else if (arg == "--dependents") {
+                options.dependents = true;
+            } else if (arg == "--plan") {
+                options.plan = true;
+            } else if (arg.rfind("--term-cap=", 0) == 0) {
+                options.termCap = stoul(arg.substr(11));
+            } else if (arg.rfind("--memory-budget=", 0) == 0) {
+                options.memoryBudget = parseSize(arg.substr(16));
+            } else if (arg == "--stats") {
+                options.statsPath = "-";
+            } else if (arg.rfind("--stats=", 0) == 0) {
+                options.statsPath = arg.substr(8);
+            } else if (arg == "--bench") {
+                options.bench = DEFAULT_BENCH_MAX_EXPONENT;
+            } else if (arg.rfind("--bench=", 0) == 0) {
+                options.bench = stoi(arg.substr(8));
+                // Course numbers run out before 10^9 courses
+                if (options.bench < 2 || options.bench > 8)
+                    throw out_of_range(arg);
+            } else if (arg == "--background") {
+                options.background = true;
+            } else if (arg == "--foreground") {
+                options.background = false;
+            } else if (arg == "--shard") {
+                options.shard = true;
+            } else if (arg == "--batch") {
+                options.batchPath = "-";
+            } else if (arg.rfind("--batch=", 0) == 0) {
+                options.batchPath = arg.substr(8);
+            } else {
+                options.csvPaths.push_back(arg);
+            }
+        } catch (logic_error &e) {
+            // covers both invalid_argument and out_of_range
+            cerr << "Invalid option " << arg << endl;
+            return 1;
+        }
+    }
+
+    // The benchmark makes up its own catalogs
+    if (options.bench > 0)
+        return Benchmark(options).run(cout);
+
+    if (options.csvPaths.empty() && !options.batchPath.empty()) {
+        // stdin may well be the list of queries, so don't prompt on it
+        options.csvPaths.push_back("CS 300 ABCU_Advising_Program_Input.csv");
+    } else if (options.csvPaths.empty()) {
         cout << "Please enter the path to the csv data file [CS 300 ABCU_Advising_Program_Input.csv]:" << endl;
         getline(cin, csvPath);
         if (csvPath.empty()) {
@@ -770,12 +6755,31 @@ int main(int argc, char *argv[]) {
             cerr << "File " << csvPath << " does not exist" << endl;
             return 1;
         }
+        options.csvPaths.push_back(csvPath);
     }
 
     // Create a new Driver and run it
-    driver = new Driver(csvPath);
-    driver->run();
+    try {
+        driver = new Driver(options);
+    } catch (invalid_argument &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    status = 0;
+    if (options.batchPath.empty()) {
+        driver->run();
+    } else if (options.batchPath == "-") {
+        status = driver->batch(cin, cout);
+    } else {
+        ifstream queries(options.batchPath);
+        if (!queries) {
+            cerr << "Unable to open " << options.batchPath << endl;
+            status = 1;
+        } else {
+            status = driver->batch(queries, cout);
+        }
+    }
 
     delete driver;
-    return 0;
+    return status;
 }